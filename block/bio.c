@@ -28,6 +28,7 @@
 #include <linux/mempool.h>
 #include <linux/workqueue.h>
 #include <linux/cgroup.h>
+#include <linux/cpuhotplug.h>
 
 #include <trace/events/block.h>
 #include "blk.h"
@@ -38,6 +39,12 @@
  */
 #define BIO_INLINE_VECS		4
 
+/*
+ * Upper bound of bios kept in each per-cpu cache of a bio_set created
+ * with BIOSET_PERCPU_CACHE.
+ */
+#define BIO_ALLOC_CACHE_MAX	128
+
 /*
  * if you change this list, also change bvec_alloc or things will
  * break badly! cannot be bigger than what you can fit into an
@@ -246,6 +253,75 @@ void bio_uninit(struct bio *bio)
 }
 EXPORT_SYMBOL(bio_uninit);
 
+/*
+ * Recycle @bio into the per-cpu cache of its bio_set.  This may be called
+ * from any context, including hard irq completions.
+ *
+ * While the mempool is short of its reserve the bio goes back there
+ * instead: mempool_alloc() callers sleeping for a reserve element are
+ * only woken by mempool_free(), and a cached bio would never reach them.
+ */
+static bool bio_put_percpu_cache(struct bio *bio)
+{
+	mempool_t *pool = bio->bi_pool->bio_pool;
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	bool cached = false;
+
+	if (READ_ONCE(pool->curr_nr) < pool->min_nr)
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bio->bi_pool->cache);
+	if (cache->nr < BIO_ALLOC_CACHE_MAX) {
+		bio->bi_next = cache->free_list;
+		cache->free_list = bio;
+		cache->nr++;
+		cached = true;
+	}
+	local_irq_restore(flags);
+
+	return cached;
+}
+
+static struct bio *bio_get_percpu_cache(struct bio_set *bs)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	struct bio *bio;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	bio = cache->free_list;
+	if (bio) {
+		cache->free_list = bio->bi_next;
+		cache->nr--;
+	}
+	local_irq_restore(flags);
+
+	return bio;
+}
+
+static void bio_alloc_cache_drain(struct bio_set *bs,
+				  struct bio_alloc_cache *cache)
+{
+	struct bio *bio;
+
+	while ((bio = cache->free_list) != NULL) {
+		cache->free_list = bio->bi_next;
+		cache->nr--;
+		mempool_free((void *)bio - bs->front_pad, bs->bio_pool);
+	}
+}
+
+static int bio_cpu_dead(unsigned int cpu, struct hlist_node *node)
+{
+	struct bio_set *bs = hlist_entry_safe(node, struct bio_set, cpuhp_dead);
+
+	bio_alloc_cache_drain(bs, per_cpu_ptr(bs->cache, cpu));
+	return 0;
+}
+
 static void bio_free(struct bio *bio)
 {
 	struct bio_set *bs = bio->bi_pool;
@@ -253,6 +329,9 @@ static void bio_free(struct bio *bio)
 
 	bio_uninit(bio);
 
+	if (bio_flagged(bio, BIO_PERCPU_CACHE) && bio_put_percpu_cache(bio))
+		return;
+
 	if (bs) {
 		bvec_free(bs->bvec_pool, bio->bi_io_vec, BVEC_POOL_IDX(bio));
 
@@ -456,6 +535,17 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, unsigned int nr_iovecs,
 		/* should not use nobvec bioset for nr_iovecs > 0 */
 		if (WARN_ON_ONCE(!bs->bvec_pool && nr_iovecs > 0))
 			return NULL;
+
+		if (bs->cache && nr_iovecs <= BIO_INLINE_VECS) {
+			bio = bio_get_percpu_cache(bs);
+			if (bio) {
+				bio_init(bio, nr_iovecs ? bio->bi_inline_vecs :
+					 NULL, nr_iovecs);
+				bio->bi_pool = bs;
+				bio_set_flag(bio, BIO_PERCPU_CACHE);
+				return bio;
+			}
+		}
 		/*
 		 * generic_make_request() converts recursion to iteration; this
 		 * means if we're running beneath it, any bios we allocate and
@@ -521,6 +611,8 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, unsigned int nr_iovecs,
 	bio->bi_pool = bs;
 	bio->bi_max_vecs = nr_iovecs;
 	bio->bi_io_vec = bvl;
+	if (bs && bs->cache && nr_iovecs <= BIO_INLINE_VECS)
+		bio_set_flag(bio, BIO_PERCPU_CACHE);
 	return bio;
 
 err_free:
@@ -1944,6 +2036,7 @@ void bio_endio(struct bio *bio)
 	}
 
 	blk_throtl_bio_endio(bio);
+	blk_iolatency_bio_endio(bio);
 	/* release cgroup info */
 	bio_uninit(bio);
 	if (bio->bi_end_io)
@@ -2033,6 +2126,16 @@ mempool_t *biovec_create_pool(int pool_entries)
 
 void bioset_free(struct bio_set *bs)
 {
+	if (bs->cache) {
+		int cpu;
+
+		cpuhp_state_remove_instance_nocalls(CPUHP_BIO_DEAD,
+						    &bs->cpuhp_dead);
+		for_each_possible_cpu(cpu)
+			bio_alloc_cache_drain(bs, per_cpu_ptr(bs->cache, cpu));
+		free_percpu(bs->cache);
+	}
+
 	if (bs->rescue_workqueue)
 		destroy_workqueue(bs->rescue_workqueue);
 
@@ -2053,8 +2156,8 @@ EXPORT_SYMBOL(bioset_free);
  * bioset_create  - Create a bio_set
  * @pool_size:	Number of bio and bio_vecs to cache in the mempool
  * @front_pad:	Number of bytes to allocate in front of the returned bio
- * @flags:	Flags to modify behavior, currently %BIOSET_NEED_BVECS
- *              and %BIOSET_NEED_RESCUER
+ * @flags:	Flags to modify behavior, currently %BIOSET_NEED_BVECS,
+ *              %BIOSET_NEED_RESCUER and %BIOSET_PERCPU_CACHE
  *
  * Description:
  *    Set up a bio_set to be used with @bio_alloc_bioset. Allows the caller
@@ -2067,6 +2170,9 @@ EXPORT_SYMBOL(bioset_free);
  *    for allocating iovecs.  This pool is not needed e.g. for bio_clone_fast().
  *    If %BIOSET_NEED_RESCUER is set, a workqueue is created which can be used to
  *    dispatch queued requests when the mempool runs out of space.
+ *    If %BIOSET_PERCPU_CACHE is set, freed bios with inline vecs are kept in
+ *    a bounded per-cpu cache and handed out again without going through
+ *    the mempool.
  *
  */
 struct bio_set *bioset_create(unsigned int pool_size,
@@ -2102,6 +2208,14 @@ struct bio_set *bioset_create(unsigned int pool_size,
 			goto bad;
 	}
 
+	if (flags & BIOSET_PERCPU_CACHE) {
+		bs->cache = alloc_percpu(struct bio_alloc_cache);
+		if (!bs->cache)
+			goto bad;
+		cpuhp_state_add_instance_nocalls(CPUHP_BIO_DEAD,
+						 &bs->cpuhp_dead);
+	}
+
 	if (!(flags & BIOSET_NEED_RESCUER))
 		return bs;
 
@@ -2230,7 +2344,11 @@ static int __init init_bio(void)
 	bio_integrity_init();
 	biovec_init_slabs();
 
-	fs_bio_set = bioset_create(BIO_POOL_SIZE, 0, BIOSET_NEED_BVECS);
+	cpuhp_setup_state_multi(CPUHP_BIO_DEAD, "block/bio:dead", NULL,
+				bio_cpu_dead);
+
+	fs_bio_set = bioset_create(BIO_POOL_SIZE, 0,
+				   BIOSET_NEED_BVECS | BIOSET_PERCPU_CACHE);
 	if (!fs_bio_set)
 		panic("bio: can't allocate bios\n");
 
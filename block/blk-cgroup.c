@@ -961,13 +961,19 @@ static int blkcg_print_stat(struct seq_file *sf, void *v)
 
 	hlist_for_each_entry_rcu(blkg, &blkcg->blkg_list, blkcg_node) {
 		const char *dname;
+		char *buf;
 		struct blkg_rwstat rwstat;
 		u64 rbytes, wbytes, rios, wios;
+		size_t size = seq_get_buf(sf, &buf), off = 0;
+		bool has_stats = false;
+		int i;
 
 		dname = blkg_dev_name(blkg);
 		if (!dname)
 			continue;
 
+		off += scnprintf(buf + off, size - off, "%s", dname);
+
 		spin_lock_irq(blkg->q->queue_lock);
 
 		rwstat = blkg_rwstat_recursive_sum(blkg, NULL,
@@ -982,9 +988,37 @@ static int blkcg_print_stat(struct seq_file *sf, void *v)
 
 		spin_unlock_irq(blkg->q->queue_lock);
 
-		if (rbytes || wbytes || rios || wios)
-			seq_printf(sf, "%s rbytes=%llu wbytes=%llu rios=%llu wios=%llu\n",
-				   dname, rbytes, wbytes, rios, wios);
+		if (rbytes || wbytes || rios || wios) {
+			has_stats = true;
+			off += scnprintf(buf + off, size - off,
+					 " rbytes=%llu wbytes=%llu rios=%llu wios=%llu",
+					 rbytes, wbytes, rios, wios);
+		}
+
+		/* policies append their own " key=value" pairs */
+		for (i = 0; i < BLKCG_MAX_POLS; i++) {
+			struct blkcg_policy *pol = blkcg_policy[i];
+			size_t written;
+
+			if (!pol || !blkg->pd[i] || !pol->pd_stat_fn)
+				continue;
+
+			written = pol->pd_stat_fn(blkg->pd[i], buf + off,
+						  size - off);
+			if (written)
+				has_stats = true;
+			off += written;
+		}
+
+		if (has_stats) {
+			/* on overflow, make seq_file retry with a larger buffer */
+			if (off < size - 1) {
+				off += scnprintf(buf + off, size - off, "\n");
+				seq_commit(sf, off);
+			} else {
+				seq_commit(sf, -1);
+			}
+		}
 	}
 
 	rcu_read_unlock();
@@ -1171,6 +1205,11 @@ int blkcg_init_queue(struct request_queue *q)
 		radix_tree_preload_end();
 
 	ret = blk_throtl_init(q);
+	if (!ret) {
+		ret = blk_iolatency_init(q);
+		if (ret)
+			blk_throtl_exit(q);
+	}
 	if (ret) {
 		spin_lock_irq(q->queue_lock);
 		blkg_destroy_all(q);
@@ -1219,6 +1258,7 @@ void blkcg_exit_queue(struct request_queue *q)
 	spin_unlock_irq(q->queue_lock);
 
 	blk_throtl_exit(q);
+	blk_iolatency_exit(q);
 }
 
 /*
@@ -2209,6 +2209,13 @@ blk_qc_t generic_make_request(struct bio *bio)
 	if (!generic_make_request_checks(bio))
 		goto out;
 
+	/*
+	 * io.latency charges the bio an inflight slot and may wait for one.
+	 * Only wait when no make_request_fn is active: bios parked on
+	 * current->bio_list can hold slots and are issued after we return.
+	 */
+	blk_iolatency_throttle(bio, !current->bio_list);
+
 	/*
 	 * We only want one ->make_request_fn to be active at a time, else
 	 * stack usage with stacked devices could be a problem.  So use
@@ -3322,6 +3329,8 @@ void blk_start_plug(struct blk_plug *plug)
 	INIT_LIST_HEAD(&plug->list);
 	INIT_LIST_HEAD(&plug->mq_list);
 	INIT_LIST_HEAD(&plug->cb_list);
+	INIT_LIST_HEAD(&plug->mq_cached_list);
+	plug->mq_alloc_batch = false;
 	/*
 	 * Store ordering should not be needed here, since a potential
 	 * preempt will imply a full memory barrier
@@ -3414,6 +3423,13 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	if (!list_empty(&plug->mq_list))
 		blk_mq_flush_plug_list(plug, from_schedule);
 
+	/*
+	 * Don't sit on pre-allocated tags while sleeping, a queue freeze
+	 * would have to wait for us.
+	 */
+	if (from_schedule && !list_empty(&plug->mq_cached_list))
+		blk_mq_free_plug_rqs(plug);
+
 	if (list_empty(&plug->list))
 		return;
 
@@ -3470,6 +3486,8 @@ void blk_finish_plug(struct blk_plug *plug)
 	if (plug != current->plug)
 		return;
 	blk_flush_plug_list(plug, false);
+	if (!list_empty(&plug->mq_cached_list))
+		blk_mq_free_plug_rqs(plug);
 
 	current->plug = NULL;
 }
@@ -0,0 +1,158 @@
+/*
+ * Latency-targeted dirty throttling.
+ *
+ * Read and write completion latencies of a queue are sampled with blk-stat
+ * in fixed windows.  When reads in a window complete slower on average than
+ * the target while writes are going on, the dirty throttling step of the
+ * queue's bdi goes up by one.  Every step halves the bdi's dirty threshold
+ * (see __wb_calc_thresh()) and the size of the writeback chunks sent to it
+ * (see writeback_chunk_size()), so a flood of buffered writes queues less
+ * in front of foreground reads.  After a few windows back under the target,
+ * or without reads, the step comes down again one at a time.
+ *
+ * This is complementary to wbt, which limits the queue depth used by
+ * writeback requests: here the VM is told to keep less dirty data around
+ * for the device in the first place.
+ */
+#include <linux/kernel.h>
+#include <linux/blk_types.h>
+#include <linux/slab.h>
+#include <linux/backing-dev.h>
+
+#include "blk-stat.h"
+#include "blk-dirty-lat.h"
+
+enum {
+	/*
+	 * 100msec window
+	 */
+	DIRTY_LAT_WINDOW_MSEC	= 100,
+
+	/*
+	 * Don't shrink the dirty threshold below 1/16th
+	 */
+	DIRTY_LAT_MAX_STEP	= 4,
+
+	/*
+	 * Number of consecutive windows within the target before stepping
+	 * back down
+	 */
+	DIRTY_LAT_RELAX_WINDOWS	= 4,
+};
+
+struct rq_dirty_lat {
+	struct blk_stat_callback *cb;
+	struct request_queue *queue;
+	u64 target_nsec;
+	unsigned int good_windows;
+};
+
+static int dirty_lat_data_dir(const struct request *rq)
+{
+	const int op = req_op(rq);
+
+	if (op == REQ_OP_READ)
+		return READ;
+	else if (op == REQ_OP_WRITE)
+		return WRITE;
+
+	/* don't account */
+	return -1;
+}
+
+static void dirty_lat_timer_fn(struct blk_stat_callback *cb)
+{
+	struct rq_dirty_lat *rdl = cb->data;
+	struct backing_dev_info *bdi = rdl->queue->backing_dev_info;
+	struct blk_rq_stat *stat = cb->stat;
+	unsigned int step = bdi->dirty_lat_step;
+
+	if (stat[READ].nr_samples)
+		WRITE_ONCE(bdi->dirty_lat_read_nsec, stat[READ].mean);
+	if (stat[WRITE].nr_samples)
+		WRITE_ONCE(bdi->dirty_lat_write_nsec, stat[WRITE].mean);
+
+	/*
+	 * Only blame writeback when there were writes to contend with:
+	 * slow reads alone are not something the VM can help with.
+	 */
+	if (stat[READ].nr_samples && stat[WRITE].nr_samples &&
+	    stat[READ].mean > rdl->target_nsec) {
+		rdl->good_windows = 0;
+		if (step < DIRTY_LAT_MAX_STEP) {
+			WRITE_ONCE(bdi->dirty_lat_step, step + 1);
+			WRITE_ONCE(bdi->dirty_lat_throttled,
+				   bdi->dirty_lat_throttled + 1);
+		}
+	} else if (step && ++rdl->good_windows >= DIRTY_LAT_RELAX_WINDOWS) {
+		rdl->good_windows = 0;
+		WRITE_ONCE(bdi->dirty_lat_step, step - 1);
+		WRITE_ONCE(bdi->dirty_lat_relaxed, bdi->dirty_lat_relaxed + 1);
+	}
+
+	blk_stat_activate_msecs(cb, DIRTY_LAT_WINDOW_MSEC);
+}
+
+static int blk_dirty_lat_init(struct request_queue *q)
+{
+	struct rq_dirty_lat *rdl;
+
+	rdl = kzalloc(sizeof(*rdl), GFP_KERNEL);
+	if (!rdl)
+		return -ENOMEM;
+
+	rdl->cb = blk_stat_alloc_callback(dirty_lat_timer_fn,
+					  dirty_lat_data_dir, 2, rdl);
+	if (!rdl->cb) {
+		kfree(rdl);
+		return -ENOMEM;
+	}
+
+	rdl->queue = q;
+	q->rq_dirty_lat = rdl;
+	blk_stat_add_callback(q, rdl->cb);
+	blk_stat_activate_msecs(rdl->cb, DIRTY_LAT_WINDOW_MSEC);
+
+	return 0;
+}
+
+/*
+ * Set the read latency target, or turn throttling off with 0.  Called with
+ * q->sysfs_lock held.
+ */
+int blk_dirty_lat_set_target(struct request_queue *q, u64 nsec)
+{
+	int ret;
+
+	if (!nsec) {
+		blk_dirty_lat_exit(q);
+		return 0;
+	}
+
+	if (!q->rq_dirty_lat) {
+		ret = blk_dirty_lat_init(q);
+		if (ret)
+			return ret;
+	}
+
+	WRITE_ONCE(q->rq_dirty_lat->target_nsec, nsec);
+	return 0;
+}
+
+u64 blk_dirty_lat_target(struct request_queue *q)
+{
+	return q->rq_dirty_lat ? q->rq_dirty_lat->target_nsec : 0;
+}
+
+void blk_dirty_lat_exit(struct request_queue *q)
+{
+	struct rq_dirty_lat *rdl = q->rq_dirty_lat;
+
+	if (rdl) {
+		blk_stat_remove_callback(q, rdl->cb);
+		blk_stat_free_callback(rdl->cb);
+		q->rq_dirty_lat = NULL;
+		kfree(rdl);
+		WRITE_ONCE(q->backing_dev_info->dirty_lat_step, 0);
+	}
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef BLK_DIRTY_LAT_H
+#define BLK_DIRTY_LAT_H
+
+#include <linux/blkdev.h>
+
+#ifdef CONFIG_BLK_DIRTY_LAT
+
+int blk_dirty_lat_set_target(struct request_queue *, u64);
+u64 blk_dirty_lat_target(struct request_queue *);
+void blk_dirty_lat_exit(struct request_queue *);
+
+#else
+
+static inline int blk_dirty_lat_set_target(struct request_queue *q, u64 nsec)
+{
+	return -EINVAL;
+}
+static inline u64 blk_dirty_lat_target(struct request_queue *q)
+{
+	return 0;
+}
+static inline void blk_dirty_lat_exit(struct request_queue *q)
+{
+}
+
+#endif /* CONFIG_BLK_DIRTY_LAT */
+
+#endif
@@ -0,0 +1,636 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Latency target based cgroup IO protection
+ *
+ * Each cgroup may declare a completion latency target for a device.  The
+ * completion latency of every tracked bio is sorted into a per-group
+ * histogram and, once per window, the p90 of the window is compared to the
+ * group's target.  When a group misses its target, its siblings (and the
+ * siblings of its ancestors) with a looser target, or none at all, get
+ * their queue depth halved.  Once no miss has been seen for a couple of
+ * windows the depth is raised again step by step until it is unlimited.
+ *
+ * Bios are charged to the blkg they were issued from; the depth limit of
+ * a group only applies to IO issued directly by that group.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/blk-cgroup.h>
+#include "blk.h"
+#include "blk-stat.h"
+
+/* Latencies are evaluated over windows of this length */
+#define IOLAT_WINDOW_NSEC	(100 * NSEC_PER_MSEC)
+/* A window with fewer completions is extended rather than evaluated */
+#define IOLAT_MIN_SAMPLES	8
+/* A miss throttles looser siblings for this many windows */
+#define IOLAT_MISS_WINDOWS	2
+/* Percentile compared against the target */
+#define IOLAT_TARGET_PCT	90
+
+/* completion latencies use the log-linear buckets from blk-stat.h */
+#define IOLAT_HIST_BUCKETS	BLK_LAT_HIST_BUCKETS
+
+struct iolat_cpu_stat {
+	struct blk_rq_stat rqs;
+	u64 hist[IOLAT_HIST_BUCKETS];
+};
+
+struct iolat_grp {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	/* configured target, 0 if none */
+	u64 target_ns;
+
+	/* allowed number of inflight tracked bios, UINT_MAX if unlimited */
+	unsigned int max_depth;
+	atomic_t inflight;
+	wait_queue_head_t wait;
+	atomic64_t last_scale;
+
+	/*
+	 * Most recent target miss of a descendant, the tightest missed
+	 * target and the child of this group it was seen below.
+	 */
+	u64 child_miss_time;
+	u64 child_miss_target;
+	struct blkcg_gq *child_miss_blkg;
+
+	/* protects the window state below */
+	spinlock_t lock;
+	u64 window_start;
+	u64 last_window_p90;
+	struct blk_rq_stat total;
+	u64 prev_hist[IOLAT_HIST_BUCKETS];
+	u64 win[IOLAT_HIST_BUCKETS];
+
+	unsigned long nr_missed;
+	atomic64_t nr_throttled;
+
+	struct iolat_cpu_stat __percpu *stats;
+
+	/* number of groups with a target on this queue, root group only */
+	atomic_t nr_targets;
+};
+
+static struct blkcg_policy blkcg_policy_iolatency;
+
+static inline struct iolat_grp *pd_to_iolat(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolat_grp, pd) : NULL;
+}
+
+static inline struct iolat_grp *blkg_to_iolat(struct blkcg_gq *blkg)
+{
+	return pd_to_iolat(blkg_to_pd(blkg, &blkcg_policy_iolatency));
+}
+
+static inline struct blkcg_gq *iolat_to_blkg(struct iolat_grp *iolat)
+{
+	return pd_to_blkg(&iolat->pd);
+}
+
+/*
+ * Return the @pct percentile of @hist, or of @hist - @base if @base is
+ * given, in usecs.  The midpoint of the matching bucket is reported.
+ */
+static u64 iolat_hist_pct(const u64 *hist, const u64 *base, unsigned int pct)
+{
+	u64 nr = 0, want, seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < IOLAT_HIST_BUCKETS; i++)
+		nr += hist[i] - (base ? base[i] : 0);
+	if (!nr)
+		return 0;
+
+	want = DIV_ROUND_UP_ULL(nr * pct, 100);
+	for (i = 0; i < IOLAT_HIST_BUCKETS; i++) {
+		seen += hist[i] - (base ? base[i] : 0);
+		if (seen >= want)
+			break;
+	}
+	if (i >= IOLAT_HIST_BUCKETS - 1)
+		return blk_lat_hist_value(IOLAT_HIST_BUCKETS - 1);
+	return (blk_lat_hist_value(i) + blk_lat_hist_value(i + 1)) / 2;
+}
+
+/*
+ * Increment 'v', if 'v' is below 'below'. Returns true if we succeeded,
+ * false if 'v' + 1 would be bigger than 'below'.
+ */
+static bool atomic_inc_below(atomic_t *v, int below)
+{
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+static bool iolat_get_slot(struct iolat_grp *iolat)
+{
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+
+	if (depth == UINT_MAX) {
+		atomic_inc(&iolat->inflight);
+		return true;
+	}
+	return atomic_inc_below(&iolat->inflight, depth);
+}
+
+/*
+ * Has a group other than the subtree @iolat lives in missed a target
+ * tighter than @iolat's own within the last few windows?
+ */
+static bool iolat_sibling_missed(struct iolat_grp *iolat, u64 now)
+{
+	struct blkcg_gq *blkg = iolat_to_blkg(iolat);
+	u64 target = READ_ONCE(iolat->target_ns);
+
+	for (; blkg->parent; blkg = blkg->parent) {
+		struct iolat_grp *parent = blkg_to_iolat(blkg->parent);
+		u64 miss_time = READ_ONCE(parent->child_miss_time);
+
+		if (!miss_time ||
+		    now - miss_time > IOLAT_MISS_WINDOWS * IOLAT_WINDOW_NSEC)
+			continue;
+		if (READ_ONCE(parent->child_miss_blkg) == blkg)
+			continue;
+		if (!target || target > READ_ONCE(parent->child_miss_target))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Adjust the depth of @iolat at most once per window: halve it while a
+ * sibling is missing a tighter target, raise it by 1/8 of the queue depth
+ * otherwise.
+ */
+static void iolat_scale(struct iolat_grp *iolat, u64 now)
+{
+	struct request_queue *q = iolat_to_blkg(iolat)->q;
+	unsigned int nr_requests = max_t(unsigned int, q->nr_requests, 1);
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+	s64 last = atomic64_read(&iolat->last_scale);
+
+	if (now - last < IOLAT_WINDOW_NSEC)
+		return;
+	if (atomic64_cmpxchg(&iolat->last_scale, last, now) != last)
+		return;
+
+	if (iolat_sibling_missed(iolat, now)) {
+		if (depth == UINT_MAX)
+			depth = nr_requests;
+		depth = max(depth / 2, 1U);
+		WRITE_ONCE(iolat->max_depth, depth);
+		return;
+	}
+
+	if (depth == UINT_MAX)
+		return;
+
+	depth += max(nr_requests / 8, 1U);
+	if (depth >= nr_requests)
+		depth = UINT_MAX;
+	WRITE_ONCE(iolat->max_depth, depth);
+	wake_up_all(&iolat->wait);
+}
+
+static void iolat_record_miss(struct iolat_grp *iolat, u64 now)
+{
+	struct blkcg_gq *blkg = iolat_to_blkg(iolat);
+	u64 target = iolat->target_ns;
+
+	iolat->nr_missed++;
+
+	/* let every ancestor know which of its children missed */
+	for (; blkg->parent; blkg = blkg->parent) {
+		struct iolat_grp *parent = blkg_to_iolat(blkg->parent);
+		u64 miss_time = READ_ONCE(parent->child_miss_time);
+
+		if (miss_time &&
+		    now - miss_time <= IOLAT_MISS_WINDOWS * IOLAT_WINDOW_NSEC &&
+		    READ_ONCE(parent->child_miss_target) < target)
+			continue;
+
+		WRITE_ONCE(parent->child_miss_target, target);
+		WRITE_ONCE(parent->child_miss_blkg, blkg);
+		WRITE_ONCE(parent->child_miss_time, now);
+	}
+}
+
+/* Fold the per-cpu stats and check the p90 of the window against target */
+static void iolat_close_window(struct iolat_grp *iolat, u64 now)
+{
+	u64 nr = 0;
+	unsigned int i;
+	int cpu;
+
+	memset(iolat->win, 0, sizeof(iolat->win));
+	for_each_possible_cpu(cpu) {
+		struct iolat_cpu_stat *s = per_cpu_ptr(iolat->stats, cpu);
+
+		for (i = 0; i < IOLAT_HIST_BUCKETS; i++)
+			iolat->win[i] += READ_ONCE(s->hist[i]);
+		blk_rq_stat_sum(&iolat->total, &s->rqs);
+		blk_rq_stat_init(&s->rqs);
+	}
+
+	for (i = 0; i < IOLAT_HIST_BUCKETS; i++)
+		nr += iolat->win[i] - iolat->prev_hist[i];
+
+	iolat->window_start = now;
+	if (nr < IOLAT_MIN_SAMPLES)
+		return;
+
+	iolat->last_window_p90 = iolat_hist_pct(iolat->win, iolat->prev_hist,
+						IOLAT_TARGET_PCT);
+	memcpy(iolat->prev_hist, iolat->win, sizeof(iolat->prev_hist));
+
+	if (iolat->target_ns &&
+	    iolat->last_window_p90 * NSEC_PER_USEC > iolat->target_ns)
+		iolat_record_miss(iolat, now);
+}
+
+void blk_iolatency_track(struct request_queue *q, struct blkcg_gq *blkg,
+			 struct bio *bio)
+{
+	struct iolat_grp *root;
+
+	if (!blkg || !blkg->parent || bio->bi_iolat_blkg)
+		return;
+	if (bio_op(bio) != REQ_OP_READ && bio_op(bio) != REQ_OP_WRITE)
+		return;
+
+	/* no policy data means the policy isn't enabled on @q */
+	root = blkg_to_iolat(q->root_blkg);
+	if (!root || !atomic_read(&root->nr_targets))
+		return;
+
+	blkg_get(blkg);
+	bio->bi_iolat_blkg = blkg;
+}
+
+/*
+ * Whether @bio was issued from a group that has, or sits below, a latency
+ * target.  blk-mq lets such I/O use the tags kept by q->prio_tag_reserve.
+ * The bio pins its blkg, which pins the ancestors.
+ */
+bool blk_iolatency_protected(struct bio *bio)
+{
+	struct blkcg_gq *blkg;
+
+	for (blkg = bio->bi_iolat_blkg; blkg && blkg->parent;
+	     blkg = blkg->parent) {
+		struct iolat_grp *iolat = blkg_to_iolat(blkg);
+
+		if (iolat && READ_ONCE(iolat->target_ns))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Whether @bio should give way to latency sensitive I/O on @q: some group
+ * on @q has a target and @bio isn't covered by one.  wbt scales such
+ * writeback down first.
+ */
+bool blk_iolatency_yields(struct request_queue *q, struct bio *bio)
+{
+	struct iolat_grp *root;
+	bool ret = false;
+
+	rcu_read_lock();
+	root = q->root_blkg ? blkg_to_iolat(q->root_blkg) : NULL;
+	if (root && atomic_read(&root->nr_targets))
+		ret = !blk_iolatency_protected(bio);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Charge @bio one inflight slot of its group.  A bio is charged once: the
+ * remainder of a split comes back through generic_make_request() still
+ * holding the slot, and bio_endio() gives back only one.  Without
+ * @may_sleep the slot is taken even when the group is over its depth.
+ */
+void blk_iolatency_throttle(struct bio *bio, bool may_sleep)
+{
+	struct blkcg_gq *blkg = bio->bi_iolat_blkg;
+	struct iolat_grp *iolat;
+	DEFINE_WAIT(wait);
+
+	if (!blkg || bio->bi_iolat_start)
+		return;
+
+	iolat = blkg_to_iolat(blkg);
+	if (!iolat)
+		return;
+	iolat_scale(iolat, ktime_get_ns());
+
+	if (iolat_get_slot(iolat))
+		goto out;
+
+	/*
+	 * Don't stall IO that others may be waiting on, or that is issued
+	 * to free memory; it still takes a slot.
+	 */
+	if (!may_sleep || (bio->bi_opf & (REQ_NOWAIT | REQ_META | REQ_PRIO)) ||
+	    (current->flags & PF_MEMALLOC)) {
+		atomic_inc(&iolat->inflight);
+		goto out;
+	}
+
+	atomic64_inc(&iolat->nr_throttled);
+	do {
+		prepare_to_wait_exclusive(&iolat->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (iolat_get_slot(iolat))
+			break;
+		/* io_schedule() flushes the plug, issued IO can complete */
+		io_schedule();
+	} while (1);
+	finish_wait(&iolat->wait, &wait);
+out:
+	bio->bi_iolat_start = ktime_get_ns();
+}
+
+void blk_iolatency_bio_endio(struct bio *bio)
+{
+	struct blkcg_gq *blkg = bio->bi_iolat_blkg;
+	struct iolat_grp *iolat;
+	unsigned long flags;
+	u64 now;
+
+	if (!blkg)
+		return;
+	bio->bi_iolat_blkg = NULL;
+
+	iolat = blkg_to_iolat(blkg);
+	if (!iolat || !bio->bi_iolat_start)
+		goto out;
+
+	now = ktime_get_ns();
+	if (!bio->bi_status && now > bio->bi_iolat_start) {
+		u64 lat = now - bio->bi_iolat_start;
+		struct iolat_cpu_stat *s;
+
+		local_irq_save(flags);
+		s = this_cpu_ptr(iolat->stats);
+		blk_rq_stat_add(&s->rqs, lat);
+		s->hist[blk_lat_hist_bucket(div_u64(lat, NSEC_PER_USEC))]++;
+		local_irq_restore(flags);
+	}
+	bio->bi_iolat_start = 0;
+
+	atomic_dec(&iolat->inflight);
+	if (waitqueue_active(&iolat->wait))
+		wake_up(&iolat->wait);
+
+	if (now - READ_ONCE(iolat->window_start) >= IOLAT_WINDOW_NSEC &&
+	    spin_trylock_irqsave(&iolat->lock, flags)) {
+		if (now - iolat->window_start >= IOLAT_WINDOW_NSEC)
+			iolat_close_window(iolat, now);
+		spin_unlock_irqrestore(&iolat->lock, flags);
+	}
+
+	iolat_scale(iolat, now);
+out:
+	blkg_put(blkg);
+}
+
+static u64 iolat_prfill_latency(struct seq_file *sf,
+				struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *iolat = pd_to_iolat(pd);
+	const char *dname = blkg_dev_name(pd->blkg);
+
+	if (!dname || !iolat->target_ns)
+		return 0;
+
+	seq_printf(sf, "%s target=%llu\n", dname,
+		   div_u64(iolat->target_ns, NSEC_PER_USEC));
+	return 0;
+}
+
+static int iolat_print_latency(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill_latency,
+			  &blkcg_policy_iolatency, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static void iolat_set_target(struct iolat_grp *iolat, u64 target_ns)
+{
+	struct blkcg_gq *blkg = iolat_to_blkg(iolat);
+	struct iolat_grp *root = blkg_to_iolat(blkg->q->root_blkg);
+
+	/* the root group may already be gone while the queue is torn down */
+	if (root && !iolat->target_ns && target_ns)
+		atomic_inc(&root->nr_targets);
+	else if (root && iolat->target_ns && !target_ns)
+		atomic_dec(&root->nr_targets);
+	WRITE_ONCE(iolat->target_ns, target_ns);
+}
+
+static ssize_t iolat_set_latency(struct kernfs_open_file *of,
+				 char *buf, size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct iolat_grp *iolat;
+	u64 target;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolatency, buf, &ctx);
+	if (ret)
+		return ret;
+
+	iolat = blkg_to_iolat(ctx.blkg);
+	target = div_u64(iolat->target_ns, NSEC_PER_USEC);
+
+	while (true) {
+		char tok[28];	/* target=18446744073709551616 */
+		char *p;
+		u64 val = 0;
+		int len;
+
+		if (sscanf(ctx.body, "%27s%n", tok, &len) != 1)
+			break;
+		if (tok[0] == '\0')
+			break;
+		ctx.body += len;
+
+		ret = -EINVAL;
+		p = tok;
+		strsep(&p, "=");
+		if (!p || (sscanf(p, "%llu", &val) != 1 && strcmp(p, "max")))
+			goto out_finish;
+
+		ret = -ERANGE;
+		if (val > U64_MAX / NSEC_PER_USEC)
+			goto out_finish;
+
+		ret = -EINVAL;
+		if (!strcmp(tok, "target"))
+			target = val;
+		else
+			goto out_finish;
+	}
+
+	iolat_set_target(iolat, target * NSEC_PER_USEC);
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static size_t iolat_pd_stat(struct blkg_policy_data *pd, char *buf,
+			    size_t size)
+{
+	struct iolat_grp *iolat = pd_to_iolat(pd);
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+	u64 avg, p50, p90, p99;
+	unsigned long flags;
+	char depth_str[11] = "max";
+	size_t off;
+
+	if (!iolat->target_ns && !iolat->total.nr_samples)
+		return 0;
+
+	spin_lock_irqsave(&iolat->lock, flags);
+	avg = div_u64(iolat->total.mean, NSEC_PER_USEC);
+	p50 = iolat_hist_pct(iolat->prev_hist, NULL, 50);
+	p90 = iolat_hist_pct(iolat->prev_hist, NULL, 90);
+	p99 = iolat_hist_pct(iolat->prev_hist, NULL, 99);
+	spin_unlock_irqrestore(&iolat->lock, flags);
+
+	if (depth != UINT_MAX)
+		snprintf(depth_str, sizeof(depth_str), "%u", depth);
+
+	off = scnprintf(buf, size,
+			" lat_target=%llu lat_avg=%llu lat_p50=%llu lat_p90=%llu lat_p99=%llu depth=%s missed=%lu throttled=%llu",
+			div_u64(iolat->target_ns, NSEC_PER_USEC),
+			avg, p50, p90, p99, depth_str, iolat->nr_missed,
+			(u64)atomic64_read(&iolat->nr_throttled));
+	return off;
+}
+
+static struct cftype iolat_files[] = {
+	{
+		.name = "latency",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolat_print_latency,
+		.write = iolat_set_latency,
+	},
+	{ }	/* terminate */
+};
+
+static struct cftype iolat_legacy_files[] = {
+	{
+		.name = "latency",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolat_print_latency,
+		.write = iolat_set_latency,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkg_policy_data *iolat_pd_alloc(gfp_t gfp, int node)
+{
+	struct iolat_grp *iolat;
+
+	iolat = kzalloc_node(sizeof(*iolat), gfp, node);
+	if (!iolat)
+		return NULL;
+
+	iolat->stats = __alloc_percpu_gfp(sizeof(struct iolat_cpu_stat),
+				__alignof__(struct iolat_cpu_stat), gfp);
+	if (!iolat->stats) {
+		kfree(iolat);
+		return NULL;
+	}
+	return &iolat->pd;
+}
+
+static void iolat_pd_init(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *iolat = pd_to_iolat(pd);
+	u64 now = ktime_get_ns();
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		blk_rq_stat_init(&per_cpu_ptr(iolat->stats, cpu)->rqs);
+	blk_rq_stat_init(&iolat->total);
+
+	iolat->max_depth = UINT_MAX;
+	atomic_set(&iolat->inflight, 0);
+	init_waitqueue_head(&iolat->wait);
+	atomic64_set(&iolat->last_scale, now);
+	spin_lock_init(&iolat->lock);
+	iolat->window_start = now;
+	atomic_set(&iolat->nr_targets, 0);
+}
+
+static void iolat_pd_offline(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *iolat = pd_to_iolat(pd);
+
+	iolat_set_target(iolat, 0);
+	WRITE_ONCE(iolat->max_depth, UINT_MAX);
+	wake_up_all(&iolat->wait);
+}
+
+static void iolat_pd_free(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *iolat = pd_to_iolat(pd);
+
+	free_percpu(iolat->stats);
+	kfree(iolat);
+}
+
+static struct blkcg_policy blkcg_policy_iolatency = {
+	.dfl_cftypes		= iolat_files,
+	.legacy_cftypes		= iolat_legacy_files,
+
+	.pd_alloc_fn		= iolat_pd_alloc,
+	.pd_init_fn		= iolat_pd_init,
+	.pd_offline_fn		= iolat_pd_offline,
+	.pd_free_fn		= iolat_pd_free,
+	.pd_stat_fn		= iolat_pd_stat,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	return blkcg_activate_policy(q, &blkcg_policy_iolatency);
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	blkcg_deactivate_policy(q, &blkcg_policy_iolatency);
+}
+
+static int __init iolatency_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolatency);
+}
+
+module_init(iolatency_init);
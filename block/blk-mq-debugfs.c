@@ -23,6 +23,7 @@
 #include "blk-mq.h"
 #include "blk-mq-debugfs.h"
 #include "blk-mq-tag.h"
+#include "blk-stat.h"
 
 static int blk_flags_show(struct seq_file *m, const unsigned long flags,
 			  const char *const *flag_name, int flag_name_count)
@@ -175,6 +176,19 @@ static int queue_poll_stat_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+/* Binary, see struct blk_lat_hist_hdr for the layout. */
+static int queue_lat_hist_show(void *data, struct seq_file *m)
+{
+	return blk_stat_lat_hist_show(data, m);
+}
+
+static ssize_t queue_lat_hist_write(void *data, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	blk_stat_lat_hist_reset(data);
+	return count;
+}
+
 #define HCTX_STATE_NAME(name) [BLK_MQ_S_##name] = #name
 static const char *const hctx_state_name[] = {
 	HCTX_STATE_NAME(STOPPED),
@@ -600,6 +614,24 @@ static ssize_t hctx_run_write(void *data, const char __user *buf, size_t count,
 	return count;
 }
 
+static int hctx_prio_tags_show(void *data, struct seq_file *m)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+
+	seq_printf(m, "hits=%lu waits=%lu\n", hctx->prio_tag_hits,
+		   hctx->prio_tag_waits);
+	return 0;
+}
+
+static ssize_t hctx_prio_tags_write(void *data, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+
+	hctx->prio_tag_hits = hctx->prio_tag_waits = 0;
+	return count;
+}
+
 static int hctx_active_show(void *data, struct seq_file *m)
 {
 	struct blk_mq_hw_ctx *hctx = data;
@@ -756,6 +788,7 @@ static const struct file_operations blk_mq_debugfs_fops = {
 
 static const struct blk_mq_debugfs_attr blk_mq_debugfs_queue_attrs[] = {
 	{"poll_stat", 0400, queue_poll_stat_show},
+	{"lat_hist", 0600, queue_lat_hist_show, queue_lat_hist_write},
 	{"requeue_list", 0400, .seq_ops = &queue_requeue_list_seq_ops},
 	{"state", 0600, queue_state_show, queue_state_write},
 	{"write_hints", 0600, queue_write_hint_show, queue_write_hint_store},
@@ -776,6 +809,7 @@ static const struct blk_mq_debugfs_attr blk_mq_debugfs_hctx_attrs[] = {
 	{"dispatched", 0600, hctx_dispatched_show, hctx_dispatched_write},
 	{"queued", 0600, hctx_queued_show, hctx_queued_write},
 	{"run", 0600, hctx_run_show, hctx_run_write},
+	{"prio_tags", 0600, hctx_prio_tags_show, hctx_prio_tags_write},
 	{"active", 0400, hctx_active_show},
 	{},
 };
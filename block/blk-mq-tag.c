@@ -39,6 +39,7 @@ bool __blk_mq_tag_busy(struct blk_mq_hw_ctx *hctx)
 void blk_mq_tag_wakeup_all(struct blk_mq_tags *tags, bool include_reserve)
 {
 	sbitmap_queue_wake_all(&tags->bitmap_tags);
+	wake_up_all(&tags->prio_wait);
 	if (include_reserve)
 		sbitmap_queue_wake_all(&tags->breserved_tags);
 }
@@ -90,23 +91,70 @@ static inline bool hctx_may_queue(struct blk_mq_hw_ctx *hctx,
 	return atomic_read(&hctx->nr_active) < depth;
 }
 
+/*
+ * With q->prio_tag_reserve set, allocations without BLK_MQ_REQ_PRIO may
+ * only use this many bits of each bitmap word, the rest is kept for sync,
+ * RT and io.latency protected I/O.  Returns 0 if nothing is kept back.
+ */
+static unsigned int blk_mq_prio_tag_limit(struct blk_mq_alloc_data *data,
+					  struct sbitmap_queue *bt)
+{
+	unsigned int pct = READ_ONCE(data->q->prio_tag_reserve);
+
+	if (!pct || (data->flags & BLK_MQ_REQ_RESERVED))
+		return 0;
+
+	return max((1U << bt->sb.shift) * (100 - pct) / 100, 1U);
+}
+
 static int __blk_mq_get_tag(struct blk_mq_alloc_data *data,
 			    struct sbitmap_queue *bt)
 {
+	unsigned int shallow_depth = data->shallow_depth;
+	unsigned int limit;
+	int tag;
+
 	if (!(data->flags & BLK_MQ_REQ_INTERNAL) &&
 	    !hctx_may_queue(data->hctx, bt))
 		return -1;
-	if (data->shallow_depth)
-		return __sbitmap_queue_get_shallow(bt, data->shallow_depth);
+
+	limit = blk_mq_prio_tag_limit(data, bt);
+	if (limit && !(data->flags & BLK_MQ_REQ_PRIO) &&
+	    (!shallow_depth || limit < shallow_depth))
+		shallow_depth = limit;
+
+	if (shallow_depth)
+		tag = __sbitmap_queue_get_shallow(bt, shallow_depth);
 	else
-		return __sbitmap_queue_get(bt);
+		tag = __sbitmap_queue_get(bt);
+
+	if (tag != -1 && limit && (data->flags & BLK_MQ_REQ_PRIO) &&
+	    (tag & ((1U << bt->sb.shift) - 1)) >= limit && data->hctx)
+		data->hctx->prio_tag_hits++;
+
+	return tag;
+}
+
+/*
+ * BLK_MQ_REQ_PRIO allocations don't queue up behind everybody else on
+ * the sbitmap waitqueues, they wait on their own and are woken by every
+ * freed tag.
+ */
+static wait_queue_head_t *blk_mq_tag_wait_head(struct blk_mq_alloc_data *data,
+					       struct blk_mq_tags *tags,
+					       struct sbitmap_queue *bt)
+{
+	if ((data->flags & BLK_MQ_REQ_PRIO) && blk_mq_prio_tag_limit(data, bt))
+		return &tags->prio_wait;
+
+	return &bt_wait_ptr(bt, data->hctx)->wait;
 }
 
 unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 {
 	struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
 	struct sbitmap_queue *bt;
-	struct sbq_wait_state *ws;
+	wait_queue_head_t *wq;
 	DEFINE_WAIT(wait);
 	unsigned int tag_offset;
 	bool drop_ctx;
@@ -131,10 +179,16 @@ unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 	if (data->flags & BLK_MQ_REQ_NOWAIT)
 		return BLK_MQ_TAG_FAIL;
 
-	ws = bt_wait_ptr(bt, data->hctx);
+	wq = blk_mq_tag_wait_head(data, tags, bt);
+	if (wq == &tags->prio_wait && data->hctx)
+		data->hctx->prio_tag_waits++;
 	drop_ctx = data->ctx == NULL;
 	do {
-		prepare_to_wait(&ws->wait, &wait, TASK_UNINTERRUPTIBLE);
+		if (wq == &tags->prio_wait)
+			prepare_to_wait_exclusive(wq, &wait,
+						  TASK_UNINTERRUPTIBLE);
+		else
+			prepare_to_wait(wq, &wait, TASK_UNINTERRUPTIBLE);
 
 		tag = __blk_mq_get_tag(data, bt);
 		if (tag != -1)
@@ -168,19 +222,43 @@ unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 		else
 			bt = &tags->bitmap_tags;
 
-		finish_wait(&ws->wait, &wait);
-		ws = bt_wait_ptr(bt, data->hctx);
+		finish_wait(wq, &wait);
+		wq = blk_mq_tag_wait_head(data, tags, bt);
 	} while (1);
 
 	if (drop_ctx && data->ctx)
 		blk_mq_put_ctx(data->ctx);
 
-	finish_wait(&ws->wait, &wait);
+	finish_wait(wq, &wait);
 
 found_tag:
 	return tag + tag_offset;
 }
 
+/*
+ * Grab up to @nr_tags normal tags with a single bitmap operation, without
+ * waiting.  Returns a mask of the tags relative to @offset, or 0 if the
+ * caller should fall back to blk_mq_get_tag().  Shared tag maps aren't
+ * batched, it would defeat the fair share accounting.
+ */
+unsigned long blk_mq_get_tags(struct blk_mq_alloc_data *data,
+			      unsigned int nr_tags, unsigned int *offset)
+{
+	struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
+	unsigned long mask;
+
+	if (data->flags & (BLK_MQ_REQ_RESERVED | BLK_MQ_REQ_INTERNAL))
+		return 0;
+	if (data->shallow_depth || (data->hctx->flags & BLK_MQ_F_TAG_SHARED))
+		return 0;
+	if (READ_ONCE(data->q->prio_tag_reserve))
+		return 0;
+
+	mask = __sbitmap_queue_get_batch(&tags->bitmap_tags, nr_tags, offset);
+	*offset += tags->nr_reserved_tags;
+	return mask;
+}
+
 void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, struct blk_mq_tags *tags,
 		    struct blk_mq_ctx *ctx, unsigned int tag)
 {
@@ -189,6 +267,14 @@ void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, struct blk_mq_tags *tags,
 
 		BUG_ON(real_tag >= tags->nr_tags);
 		sbitmap_queue_clear(&tags->bitmap_tags, real_tag, ctx->cpu);
+
+		/*
+		 * sbitmap_queue_clear() has a full barrier between clearing
+		 * the bit and looking for waiters, which also orders this
+		 * check.
+		 */
+		if (waitqueue_active(&tags->prio_wait))
+			wake_up(&tags->prio_wait);
 	} else {
 		BUG_ON(tag >= tags->nr_reserved_tags);
 		sbitmap_queue_clear(&tags->breserved_tags, tag, ctx->cpu);
@@ -403,6 +489,7 @@ struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
 
 	tags->nr_tags = total_tags;
 	tags->nr_reserved_tags = reserved_tags;
+	init_waitqueue_head(&tags->prio_wait);
 
 	return blk_mq_init_bitmap_tags(tags, node, alloc_policy);
 }
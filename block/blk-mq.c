@@ -25,6 +25,7 @@
 #include <linux/delay.h>
 #include <linux/crash_dump.h>
 #include <linux/prefetch.h>
+#include <linux/ioprio.h>
 
 #include <trace/events/block.h>
 
@@ -331,6 +332,10 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 	rq->rl = NULL;
 	set_start_time_ns(rq);
 	rq->io_start_time_ns = 0;
+#endif
+#ifdef CONFIG_BLK_DEBUG_FS
+	rq->alloc_time_ns = ktime_get_ns();
+	rq->stats_sectors = 0;
 #endif
 	rq->nr_phys_segments = 0;
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
@@ -351,6 +356,131 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 	return rq;
 }
 
+/*
+ * Once a plug has allocated a request, further bios under it are likely,
+ * so grab a batch of tags in one go and park the extra requests in the
+ * plug.  Each parked request holds its own queue usage reference.
+ */
+static struct request *blk_mq_get_request_batch(struct blk_mq_alloc_data *data,
+		unsigned int op)
+{
+	struct blk_plug *plug = current->plug;
+	struct request *rq = NULL;
+	unsigned long mask;
+	unsigned int offset, i;
+
+	if (!plug)
+		return NULL;
+	if (!plug->mq_alloc_batch) {
+		plug->mq_alloc_batch = true;
+		return NULL;
+	}
+
+	/*
+	 * If this queue still has requests parked in the plug, they simply
+	 * couldn't be used for this allocation; don't hoard more tags.
+	 */
+	list_for_each_entry(rq, &plug->mq_cached_list, queuelist)
+		if (rq->q == data->q)
+			return NULL;
+	rq = NULL;
+
+	mask = blk_mq_get_tags(data, BLK_PLUG_RQ_BATCH, &offset);
+	if (!mask)
+		return NULL;
+
+	for_each_set_bit(i, &mask, BITS_PER_LONG) {
+		struct request *tmp = blk_mq_rq_ctx_init(data, offset + i, op);
+
+		if (!rq) {
+			rq = tmp;
+			continue;
+		}
+		blk_queue_enter_live(data->q);
+		list_add_tail(&tmp->queuelist, &plug->mq_cached_list);
+	}
+	return rq;
+}
+
+/*
+ * Hand out a request parked in the plug by blk_mq_get_request_batch(), if
+ * one matches the queue and the software queue we're running on.  Parked
+ * requests for this queue that were set up on another software queue can't
+ * be used from here, so give their tags back instead of sitting on them.
+ */
+static struct request *blk_mq_get_cached_request(struct request_queue *q,
+		struct bio *bio, struct blk_mq_alloc_data *data)
+{
+	struct blk_plug *plug = current->plug;
+	struct request *rq, *tmp, *found = NULL;
+
+	if (!plug || list_empty(&plug->mq_cached_list) ||
+	    op_is_flush(bio->bi_opf) || q->elevator)
+		return NULL;
+
+	data->q = q;
+	data->ctx = blk_mq_get_ctx(q);
+
+	list_for_each_entry_safe(rq, tmp, &plug->mq_cached_list, queuelist) {
+		if (rq->q != q)
+			continue;
+		if (rq->mq_ctx == data->ctx) {
+			if (!found) {
+				list_del_init(&rq->queuelist);
+				found = rq;
+			}
+			continue;
+		}
+		list_del_init(&rq->queuelist);
+		blk_mq_free_request(rq);
+	}
+
+	if (!found) {
+		blk_mq_put_ctx(data->ctx);
+		data->ctx = NULL;
+		return NULL;
+	}
+	rq = found;
+	data->hctx = blk_mq_map_queue(q, data->ctx->cpu);
+
+	rq->cmd_flags = bio->bi_opf;
+	rq->start_time = jiffies;
+#ifdef CONFIG_BLK_CGROUP
+	set_start_time_ns(rq);
+#endif
+#ifdef CONFIG_BLK_DEBUG_FS
+	rq->alloc_time_ns = ktime_get_ns();
+#endif
+	data->hctx->queued++;
+	return rq;
+}
+
+void blk_mq_free_plug_rqs(struct blk_plug *plug)
+{
+	struct request *rq;
+
+	while (!list_empty(&plug->mq_cached_list)) {
+		rq = list_first_entry(&plug->mq_cached_list, struct request,
+				      queuelist);
+		list_del_init(&rq->queuelist);
+		blk_mq_free_request(rq);
+	}
+}
+
+/*
+ * Sync, metadata and RT I/O, and I/O from cgroups with an io.latency
+ * target, may use the tags kept back by q->prio_tag_reserve.
+ */
+static bool blk_mq_prio_tag_allowed(unsigned int op, unsigned short ioprio,
+				    struct bio *bio)
+{
+	if (op_is_sync(op) || (op & (REQ_META | REQ_PRIO)))
+		return true;
+	if (IOPRIO_PRIO_CLASS(ioprio) == IOPRIO_CLASS_RT)
+		return true;
+	return bio && blk_iolatency_protected(bio);
+}
+
 static struct request *blk_mq_get_request(struct request_queue *q,
 		struct bio *bio, unsigned int op,
 		struct blk_mq_alloc_data *data)
@@ -368,6 +498,9 @@ static struct request *blk_mq_get_request(struct request_queue *q,
 		data->hctx = blk_mq_map_queue(q, data->ctx->cpu);
 	if (op & REQ_NOWAIT)
 		data->flags |= BLK_MQ_REQ_NOWAIT;
+	if (q->prio_tag_reserve &&
+	    blk_mq_prio_tag_allowed(op, bio ? bio_prio(bio) : 0, bio))
+		data->flags |= BLK_MQ_REQ_PRIO;
 
 	if (e) {
 		data->flags |= BLK_MQ_REQ_INTERNAL;
@@ -378,6 +511,10 @@ static struct request *blk_mq_get_request(struct request_queue *q,
 		 */
 		if (!op_is_flush(op) && e->type->ops.mq.limit_depth)
 			e->type->ops.mq.limit_depth(op, data);
+	} else if (bio && !op_is_flush(op)) {
+		rq = blk_mq_get_request_batch(data, op);
+		if (rq)
+			goto out;
 	}
 
 	tag = blk_mq_get_tag(data);
@@ -401,6 +538,7 @@ static struct request *blk_mq_get_request(struct request_queue *q,
 			rq->rq_flags |= RQF_ELVPRIV;
 		}
 	}
+out:
 	data->hctx->queued++;
 	return rq;
 }
@@ -517,6 +655,7 @@ EXPORT_SYMBOL_GPL(blk_mq_free_request);
 inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
 {
 	blk_account_io_done(rq);
+	blk_stat_lat_hist_add(rq);
 
 	if (rq->end_io) {
 		wbt_done(rq->q->rq_wb, &rq->issue_stat);
@@ -611,6 +750,9 @@ void blk_mq_start_request(struct request *rq)
 
 	trace_block_rq_issue(q, rq);
 
+#ifdef CONFIG_BLK_DEBUG_FS
+	rq->stats_sectors = blk_rq_sectors(rq);
+#endif
 	if (test_bit(QUEUE_FLAG_STATS, &q->queue_flags)) {
 		blk_stat_set_issue(&rq->issue_stat, blk_rq_sectors(rq));
 		rq->rq_flags |= RQF_STATS;
@@ -932,6 +1074,9 @@ bool blk_mq_get_driver_tag(struct request *rq, struct blk_mq_hw_ctx **hctx,
 
 	if (blk_mq_tag_is_reserved(data.hctx->sched_tags, rq->internal_tag))
 		data.flags |= BLK_MQ_REQ_RESERVED;
+	if (rq->q->prio_tag_reserve &&
+	    blk_mq_prio_tag_allowed(rq->cmd_flags, rq->ioprio, rq->bio))
+		data.flags |= BLK_MQ_REQ_PRIO;
 
 	rq->tag = blk_mq_get_tag(&data);
 	if (rq->tag >= 0) {
@@ -1678,7 +1823,9 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 
 	trace_block_getrq(q, bio, bio->bi_opf);
 
-	rq = blk_mq_get_request(q, bio, bio->bi_opf, &data);
+	rq = blk_mq_get_cached_request(q, bio, &data);
+	if (!rq)
+		rq = blk_mq_get_request(q, bio, bio->bi_opf, &data);
 	if (unlikely(!rq)) {
 		__wbt_done(q->rq_wb, wb_acct);
 		if (bio->bi_opf & REQ_NOWAIT)
@@ -2426,6 +2573,9 @@ struct request_queue *blk_mq_init_allocated_queue(struct blk_mq_tag_set *set,
 	if (!q->poll_cb)
 		goto err_exit;
 
+	if (blk_stat_alloc_lat_hist(q))
+		goto err_exit;
+
 	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
 	if (!q->queue_ctx)
 		goto err_exit;
@@ -33,6 +33,7 @@ bool blk_mq_dispatch_rq_list(struct request_queue *, struct list_head *);
 void blk_mq_flush_busy_ctxs(struct blk_mq_hw_ctx *hctx, struct list_head *list);
 bool blk_mq_get_driver_tag(struct request *rq, struct blk_mq_hw_ctx **hctx,
 				bool wait);
+void blk_mq_free_plug_rqs(struct blk_plug *plug);
 
 /*
  * Internal helpers for allocating/freeing the request map
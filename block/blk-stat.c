@@ -6,6 +6,7 @@
 #include <linux/kernel.h>
 #include <linux/rculist.h>
 #include <linux/blk-mq.h>
+#include <linux/seq_file.h>
 
 #include "blk-stat.h"
 #include "blk-mq.h"
@@ -13,13 +14,27 @@
 
 #define BLK_RQ_STAT_BATCH	64
 
+#ifdef CONFIG_BLK_DEBUG_FS
+#define BLK_LAT_HIST_NR		(BLK_LAT_HIST_OPS * BLK_LAT_HIST_SIZES * \
+				 BLK_LAT_HIST_PATHS * BLK_LAT_HIST_BUCKETS)
+
+/* per-cpu, folded into u64 counts when the debugfs file is read */
+struct blk_lat_hist {
+	u32 count[BLK_LAT_HIST_NR];
+};
+#endif
+
 struct blk_queue_stats {
 	struct list_head callbacks;
 	spinlock_t lock;
 	bool enable_accounting;
+#ifdef CONFIG_BLK_DEBUG_FS
+	struct blk_lat_hist __percpu *lat_hist;
+	u64 lat_hist_reset_ns;
+#endif
 };
 
-static void blk_stat_init(struct blk_rq_stat *stat)
+void blk_rq_stat_init(struct blk_rq_stat *stat)
 {
 	stat->min = -1ULL;
 	stat->max = stat->nr_samples = stat->mean = 0;
@@ -45,7 +60,7 @@ static void blk_stat_flush_batch(struct blk_rq_stat *stat)
 	stat->nr_batch = stat->batch = 0;
 }
 
-static void blk_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src)
+void blk_rq_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src)
 {
 	blk_stat_flush_batch(src);
 
@@ -65,7 +80,7 @@ static void blk_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src)
 	dst->nr_samples += src->nr_samples;
 }
 
-static void __blk_stat_add(struct blk_rq_stat *stat, u64 value)
+void blk_rq_stat_add(struct blk_rq_stat *stat, u64 value)
 {
 	stat->min = min(stat->min, value);
 	stat->max = max(stat->max, value);
@@ -104,7 +119,7 @@ void blk_stat_add(struct request *rq)
 			continue;
 
 		stat = &get_cpu_ptr(cb->cpu_stat)[bucket];
-		__blk_stat_add(stat, value);
+		blk_rq_stat_add(stat, value);
 		put_cpu_ptr(cb->cpu_stat);
 	}
 	rcu_read_unlock();
@@ -117,15 +132,15 @@ static void blk_stat_timer_fn(unsigned long data)
 	int cpu;
 
 	for (bucket = 0; bucket < cb->buckets; bucket++)
-		blk_stat_init(&cb->stat[bucket]);
+		blk_rq_stat_init(&cb->stat[bucket]);
 
 	for_each_online_cpu(cpu) {
 		struct blk_rq_stat *cpu_stat;
 
 		cpu_stat = per_cpu_ptr(cb->cpu_stat, cpu);
 		for (bucket = 0; bucket < cb->buckets; bucket++) {
-			blk_stat_sum(&cb->stat[bucket], &cpu_stat[bucket]);
-			blk_stat_init(&cpu_stat[bucket]);
+			blk_rq_stat_sum(&cb->stat[bucket], &cpu_stat[bucket]);
+			blk_rq_stat_init(&cpu_stat[bucket]);
 		}
 	}
 
@@ -178,7 +193,7 @@ void blk_stat_add_callback(struct request_queue *q,
 
 		cpu_stat = per_cpu_ptr(cb->cpu_stat, cpu);
 		for (bucket = 0; bucket < cb->buckets; bucket++)
-			blk_stat_init(&cpu_stat[bucket]);
+			blk_rq_stat_init(&cpu_stat[bucket]);
 	}
 
 	spin_lock(&q->stats->lock);
@@ -237,6 +252,9 @@ struct blk_queue_stats *blk_alloc_queue_stats(void)
 	INIT_LIST_HEAD(&stats->callbacks);
 	spin_lock_init(&stats->lock);
 	stats->enable_accounting = false;
+#ifdef CONFIG_BLK_DEBUG_FS
+	stats->lat_hist = NULL;
+#endif
 
 	return stats;
 }
@@ -248,5 +266,123 @@ void blk_free_queue_stats(struct blk_queue_stats *stats)
 
 	WARN_ON(!list_empty(&stats->callbacks));
 
+#ifdef CONFIG_BLK_DEBUG_FS
+	free_percpu(stats->lat_hist);
+#endif
 	kfree(stats);
 }
+
+#ifdef CONFIG_BLK_DEBUG_FS
+int blk_stat_alloc_lat_hist(struct request_queue *q)
+{
+	q->stats->lat_hist = alloc_percpu(struct blk_lat_hist);
+	if (!q->stats->lat_hist)
+		return -ENOMEM;
+	q->stats->lat_hist_reset_ns = ktime_get_ns();
+	return 0;
+}
+
+static int blk_lat_hist_op(struct request *rq)
+{
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		return BLK_LAT_HIST_READ;
+	case REQ_OP_WRITE:
+		return BLK_LAT_HIST_WRITE;
+	case REQ_OP_FLUSH:
+		return BLK_LAT_HIST_FLUSH;
+	case REQ_OP_DISCARD:
+	case REQ_OP_SECURE_ERASE:
+		return BLK_LAT_HIST_DISCARD;
+	default:
+		return -1;
+	}
+}
+
+static int blk_lat_hist_size(unsigned int sectors)
+{
+	if (sectors <= (4096 >> SECTOR_SHIFT))
+		return BLK_LAT_HIST_4K;
+	if (sectors <= (16384 >> SECTOR_SHIFT))
+		return BLK_LAT_HIST_16K;
+	if (sectors <= (65536 >> SECTOR_SHIFT))
+		return BLK_LAT_HIST_64K;
+	return BLK_LAT_HIST_LARGE;
+}
+
+/*
+ * Called for every completed blk-mq request.  The size is the one the
+ * request was started with, blk_rq_sectors() has already been consumed
+ * by blk_update_request() at this point.
+ */
+void blk_stat_lat_hist_add(struct request *rq)
+{
+	struct blk_lat_hist __percpu *hist = rq->q->stats->lat_hist;
+	int op = blk_lat_hist_op(rq);
+	int size, path, bucket, idx;
+	u64 now;
+
+	if (!hist || op < 0 || !rq->alloc_time_ns)
+		return;
+
+	now = ktime_get_ns();
+	if (now < rq->alloc_time_ns)
+		return;
+
+	size = blk_lat_hist_size(rq->stats_sectors);
+	path = rq->internal_tag != -1 ? BLK_LAT_HIST_SCHED : BLK_LAT_HIST_DIRECT;
+	bucket = blk_lat_hist_bucket(div_u64(now - rq->alloc_time_ns,
+					     NSEC_PER_USEC));
+
+	idx = ((op * BLK_LAT_HIST_SIZES + size) * BLK_LAT_HIST_PATHS + path) *
+		BLK_LAT_HIST_BUCKETS + bucket;
+	this_cpu_inc(hist->count[idx]);
+}
+
+/*
+ * Racing completions may land in a bucket while it is being cleared,
+ * which only loses a few samples.
+ */
+void blk_stat_lat_hist_reset(struct request_queue *q)
+{
+	struct blk_lat_hist __percpu *hist = q->stats->lat_hist;
+	int cpu;
+
+	if (!hist)
+		return;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(hist, cpu), 0, sizeof(struct blk_lat_hist));
+	q->stats->lat_hist_reset_ns = ktime_get_ns();
+}
+
+int blk_stat_lat_hist_show(struct request_queue *q, struct seq_file *m)
+{
+	struct blk_lat_hist __percpu *hist = q->stats->lat_hist;
+	struct blk_lat_hist_hdr hdr = {
+		.magic		= BLK_LAT_HIST_MAGIC,
+		.nr_ops		= BLK_LAT_HIST_OPS,
+		.nr_sizes	= BLK_LAT_HIST_SIZES,
+		.nr_paths	= BLK_LAT_HIST_PATHS,
+		.sub_bits	= BLK_LAT_HIST_SUB_BITS,
+		.nr_buckets	= BLK_LAT_HIST_BUCKETS,
+	};
+	int i, cpu;
+
+	if (!hist)
+		return -ENODEV;
+
+	hdr.reset_time_ns = q->stats->lat_hist_reset_ns;
+	seq_write(m, &hdr, sizeof(hdr));
+
+	for (i = 0; i < BLK_LAT_HIST_NR; i++) {
+		u64 sum = 0;
+
+		for_each_possible_cpu(cpu)
+			sum += per_cpu_ptr(hist, cpu)->count[i];
+		seq_write(m, &sum, sizeof(sum));
+	}
+
+	return 0;
+}
+#endif
@@ -10,11 +10,11 @@
 
 /*
  * from upper:
- * 3 bits: reserved for other usage
+ * 4 bits: reserved for other usage
  * 12 bits: size
- * 49 bits: time
+ * 48 bits: time
  */
-#define BLK_STAT_RES_BITS	3
+#define BLK_STAT_RES_BITS	4
 #define BLK_STAT_SIZE_BITS	12
 #define BLK_STAT_RES_SHIFT	(64 - BLK_STAT_RES_BITS)
 #define BLK_STAT_SIZE_SHIFT	(BLK_STAT_RES_SHIFT - BLK_STAT_SIZE_BITS)
@@ -77,11 +77,109 @@ struct blk_stat_callback {
 	struct rcu_head rcu;
 };
 
+/*
+ * Log-linear histogram of completion latencies in usecs: values below
+ * BLK_LAT_HIST_SUB get a bucket each, every power of two above that is
+ * split into BLK_LAT_HIST_SUB buckets.  80 buckets cover up to ~2 seconds,
+ * the last one also counts everything slower.
+ */
+#define BLK_LAT_HIST_SUB_BITS	2
+#define BLK_LAT_HIST_SUB	(1U << BLK_LAT_HIST_SUB_BITS)
+#define BLK_LAT_HIST_BUCKETS	80
+
+static inline unsigned int blk_lat_hist_bucket(u64 usec)
+{
+	unsigned int shift, idx;
+
+	if (usec < BLK_LAT_HIST_SUB)
+		return usec;
+
+	shift = fls64(usec) - 1 - BLK_LAT_HIST_SUB_BITS;
+	idx = (shift + 1) * BLK_LAT_HIST_SUB +
+		((usec >> shift) & (BLK_LAT_HIST_SUB - 1));
+	return min_t(unsigned int, idx, BLK_LAT_HIST_BUCKETS - 1);
+}
+
+/* lower bound of bucket @idx in usecs */
+static inline u64 blk_lat_hist_value(unsigned int idx)
+{
+	if (idx < BLK_LAT_HIST_SUB)
+		return idx;
+	return (u64)(BLK_LAT_HIST_SUB + idx % BLK_LAT_HIST_SUB) <<
+		(idx / BLK_LAT_HIST_SUB - 1);
+}
+
+/*
+ * Per-queue blk-mq latency histograms, from request allocation to
+ * completion, exported through the debugfs "lat_hist" file.  They are
+ * split by operation, by request size and by whether the request went
+ * through the I/O scheduler.
+ */
+enum {
+	BLK_LAT_HIST_READ,
+	BLK_LAT_HIST_WRITE,
+	BLK_LAT_HIST_FLUSH,
+	BLK_LAT_HIST_DISCARD,
+	BLK_LAT_HIST_OPS,
+};
+
+enum {
+	BLK_LAT_HIST_4K,		/* up to 4k, also flushes */
+	BLK_LAT_HIST_16K,		/* up to 16k */
+	BLK_LAT_HIST_64K,		/* up to 64k */
+	BLK_LAT_HIST_LARGE,		/* anything bigger */
+	BLK_LAT_HIST_SIZES,
+};
+
+enum {
+	BLK_LAT_HIST_DIRECT,		/* dispatched without a scheduler */
+	BLK_LAT_HIST_SCHED,		/* queued in the I/O scheduler */
+	BLK_LAT_HIST_PATHS,
+};
+
+#define BLK_LAT_HIST_MAGIC	0x424c4831	/* "BLH1" */
+
+/*
+ * Layout of the debugfs file: this header, followed by
+ * u64 counts[nr_ops][nr_sizes][nr_paths][nr_buckets], in native byte
+ * order.  Bucket @i counts latencies of at least blk_lat_hist_value(i)
+ * usecs.  Writing anything to the file resets all counts.
+ */
+struct blk_lat_hist_hdr {
+	u32 magic;
+	u8 nr_ops;
+	u8 nr_sizes;
+	u8 nr_paths;
+	u8 sub_bits;
+	u32 nr_buckets;
+	u32 reserved;
+	u64 reset_time_ns;		/* ktime_get_ns() of the last reset */
+};
+
 struct blk_queue_stats *blk_alloc_queue_stats(void);
 void blk_free_queue_stats(struct blk_queue_stats *);
 
 void blk_stat_add(struct request *);
 
+#ifdef CONFIG_BLK_DEBUG_FS
+struct seq_file;
+
+int blk_stat_alloc_lat_hist(struct request_queue *q);
+void blk_stat_lat_hist_add(struct request *rq);
+void blk_stat_lat_hist_reset(struct request_queue *q);
+int blk_stat_lat_hist_show(struct request_queue *q, struct seq_file *m);
+#else
+static inline int blk_stat_alloc_lat_hist(struct request_queue *q)
+{
+	return 0;
+}
+static inline void blk_stat_lat_hist_add(struct request *rq) { }
+#endif
+
+void blk_rq_stat_init(struct blk_rq_stat *stat);
+void blk_rq_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src);
+void blk_rq_stat_add(struct blk_rq_stat *stat, u64 value);
+
 static inline u64 __blk_stat_time(u64 time)
 {
 	return time & BLK_STAT_TIME_MASK;
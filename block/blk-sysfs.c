@@ -16,6 +16,7 @@
 #include "blk-mq.h"
 #include "blk-mq-debugfs.h"
 #include "blk-wbt.h"
+#include "blk-dirty-lat.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -396,6 +397,31 @@ static ssize_t queue_poll_delay_store(struct request_queue *q, const char *page,
 	return count;
 }
 
+static ssize_t queue_prio_tag_reserve_show(struct request_queue *q,
+					   char *page)
+{
+	return queue_var_show(q->prio_tag_reserve, page);
+}
+
+static ssize_t queue_prio_tag_reserve_store(struct request_queue *q,
+					    const char *page, size_t count)
+{
+	unsigned long pct;
+	ssize_t ret;
+
+	if (!q->mq_ops)
+		return -EINVAL;
+
+	ret = queue_var_store(&pct, page, count);
+	if (ret < 0)
+		return ret;
+	if (pct > 50)
+		return -EINVAL;
+
+	WRITE_ONCE(q->prio_tag_reserve, pct);
+	return ret;
+}
+
 static ssize_t queue_poll_show(struct request_queue *q, char *page)
 {
 	return queue_var_show(test_bit(QUEUE_FLAG_POLL, &q->queue_flags), page);
@@ -424,6 +450,28 @@ static ssize_t queue_poll_store(struct request_queue *q, const char *page,
 	return ret;
 }
 
+static ssize_t queue_dirty_lat_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%llu\n", div_u64(blk_dirty_lat_target(q), 1000));
+}
+
+static ssize_t queue_dirty_lat_store(struct request_queue *q, const char *page,
+				     size_t count)
+{
+	unsigned long long val;
+	int ret;
+
+	ret = kstrtoull(page, 10, &val);
+	if (ret < 0)
+		return ret;
+
+	ret = blk_dirty_lat_set_target(q, val * 1000ULL);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
 static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
 {
 	if (!q->rq_wb)
@@ -662,6 +710,12 @@ static struct queue_sysfs_entry queue_poll_delay_entry = {
 	.store = queue_poll_delay_store,
 };
 
+static struct queue_sysfs_entry queue_prio_tag_reserve_entry = {
+	.attr = {.name = "prio_tag_reserve", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_prio_tag_reserve_show,
+	.store = queue_prio_tag_reserve_store,
+};
+
 static struct queue_sysfs_entry queue_wc_entry = {
 	.attr = {.name = "write_cache", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_wc_show,
@@ -673,6 +727,12 @@ static struct queue_sysfs_entry queue_dax_entry = {
 	.show = queue_dax_show,
 };
 
+static struct queue_sysfs_entry queue_dirty_lat_entry = {
+	.attr = {.name = "dirty_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_dirty_lat_show,
+	.store = queue_dirty_lat_store,
+};
+
 static struct queue_sysfs_entry queue_wb_lat_entry = {
 	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_wb_lat_show,
@@ -719,7 +779,9 @@ static struct attribute *default_attrs[] = {
 	&queue_wc_entry.attr,
 	&queue_dax_entry.attr,
 	&queue_wb_lat_entry.attr,
+	&queue_dirty_lat_entry.attr,
 	&queue_poll_delay_entry.attr,
+	&queue_prio_tag_reserve_entry.attr,
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 	&throtl_sample_time_entry.attr,
 #endif
@@ -940,7 +1002,7 @@ void blk_unregister_queue(struct gendisk *disk)
 	mutex_unlock(&q->sysfs_lock);
 
 	wbt_exit(q);
-
+	blk_dirty_lat_exit(q);
 
 	if (q->mq_ops)
 		blk_mq_unregister_dev(disk_to_dev(disk), q);
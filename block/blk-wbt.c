@@ -14,6 +14,10 @@
  *   scaling step of 0 if reads show up or the heavy writers finish. Unlike
  *   positive scaling steps where we shrink the monitoring window, a negative
  *   scaling step retains the default step==0 window size.
+ * - Writes at idle ioprio, or from a blkcg not covered by an io.latency
+ *   target while others are, have their own budget. On a latency violation
+ *   that budget is halved first, and it is only given back once everyone
+ *   else is back at step 0.
  *
  * Copyright (C) 2016 Jens Axboe
  *
@@ -23,8 +27,10 @@
 #include <linux/slab.h>
 #include <linux/backing-dev.h>
 #include <linux/swap.h>
+#include <linux/ioprio.h>
 
 #include "blk-wbt.h"
+#include "blk.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/wbt.h>
@@ -101,9 +107,15 @@ static bool wb_recent_wait(struct rq_wb *rwb)
 	return time_before(jiffies, wb->dirty_sleep + HZ);
 }
 
-static inline struct rq_wait *get_rq_wait(struct rq_wb *rwb, bool is_kswapd)
+static inline struct rq_wait *get_rq_wait(struct rq_wb *rwb,
+					  enum wbt_flags wb_acct)
 {
-	return &rwb->rq_wait[is_kswapd];
+	if (wb_acct & WBT_KSWAPD)
+		return &rwb->rq_wait[WBT_RWQ_KSWAPD];
+	else if (wb_acct & WBT_LOWPRIO)
+		return &rwb->rq_wait[WBT_RWQ_LOWPRIO];
+
+	return &rwb->rq_wait[WBT_RWQ_NORMAL];
 }
 
 static void rwb_wake_all(struct rq_wb *rwb)
@@ -126,7 +138,7 @@ void __wbt_done(struct rq_wb *rwb, enum wbt_flags wb_acct)
 	if (!(wb_acct & WBT_TRACKED))
 		return;
 
-	rqw = get_rq_wait(rwb, wb_acct & WBT_KSWAPD);
+	rqw = get_rq_wait(rwb, wb_acct);
 	inflight = atomic_dec_return(&rqw->inflight);
 
 	/*
@@ -147,6 +159,9 @@ void __wbt_done(struct rq_wb *rwb, enum wbt_flags wb_acct)
 	else
 		limit = rwb->wb_normal;
 
+	if (wb_acct & WBT_LOWPRIO)
+		limit = min(limit, (int)rwb->wb_lowprio);
+
 	/*
 	 * Don't wake anyone up if we are above the normal limit.
 	 */
@@ -196,6 +211,7 @@ static bool calc_wb_limits(struct rq_wb *rwb)
 
 	if (!rwb->min_lat_nsec) {
 		rwb->wb_max = rwb->wb_normal = rwb->wb_background = 0;
+		rwb->wb_lowprio = 0;
 		return false;
 	}
 
@@ -214,6 +230,7 @@ static bool calc_wb_limits(struct rq_wb *rwb)
 			ret = true;
 		}
 		rwb->wb_background = 1;
+		rwb->wb_lowprio = rwb->lowprio_step > 0 ? 1 : rwb->wb_normal;
 	} else {
 		/*
 		 * scale_step == 0 is our default state. If we have suffered
@@ -242,6 +259,8 @@ static bool calc_wb_limits(struct rq_wb *rwb)
 		rwb->wb_max = depth;
 		rwb->wb_normal = (rwb->wb_max + 1) / 2;
 		rwb->wb_background = (rwb->wb_max + 3) / 4;
+		rwb->wb_lowprio = 1 + ((rwb->wb_normal - 1) >>
+				       min(31, rwb->lowprio_step));
 	}
 
 	return ret;
@@ -266,7 +285,10 @@ static u64 rwb_sync_issue_lat(struct rq_wb *rwb)
 	if (!issue || !rwb->sync_cookie)
 		return 0;
 
-	now = ktime_to_ns(ktime_get());
+	/* the issue time is truncated to the blk_issue_stat time bits */
+	now = __blk_stat_time(ktime_to_ns(ktime_get()));
+	if (now < issue)
+		return 0;
 	return now - issue;
 }
 
@@ -334,11 +356,33 @@ static void rwb_trace_step(struct rq_wb *rwb, const char *msg)
 	struct backing_dev_info *bdi = rwb->queue->backing_dev_info;
 
 	trace_wbt_step(bdi, msg, rwb->scale_step, rwb->cur_win_nsec,
-			rwb->wb_background, rwb->wb_normal, rwb->wb_max);
+			rwb->wb_background, rwb->wb_normal, rwb->wb_max,
+			rwb->lowprio_step, rwb->wb_lowprio);
+}
+
+static bool rwb_lowprio_active(struct rq_wb *rwb)
+{
+	struct rq_wait *rqw = &rwb->rq_wait[WBT_RWQ_LOWPRIO];
+
+	return atomic_read(&rqw->inflight) || waitqueue_active(&rqw->wait);
 }
 
 static void scale_up(struct rq_wb *rwb)
 {
+	/*
+	 * Everybody else is back to the default depth, now let low priority
+	 * writeback recover before boosting further.
+	 */
+	if (rwb->scale_step <= 0 && rwb->lowprio_step > 0) {
+		rwb->lowprio_step--;
+		rwb->scaled_max = false;
+		rwb->unknown_cnt = 0;
+		calc_wb_limits(rwb);
+		rwb_wake_all(rwb);
+		rwb_trace_step(rwb, "lowprio step up");
+		return;
+	}
+
 	/*
 	 * Hit max in previous round, stop here
 	 */
@@ -361,6 +405,19 @@ static void scale_up(struct rq_wb *rwb)
  */
 static void scale_down(struct rq_wb *rwb, bool hard_throttle)
 {
+	/*
+	 * On a latency violation, low priority writeback that is competing
+	 * gives up its depth before anyone else's is touched.
+	 */
+	if (hard_throttle && rwb->wb_lowprio > 1 && rwb_lowprio_active(rwb)) {
+		rwb->lowprio_step++;
+		rwb->scaled_max = false;
+		rwb->unknown_cnt = 0;
+		calc_wb_limits(rwb);
+		rwb_trace_step(rwb, "lowprio step down");
+		return;
+	}
+
 	/*
 	 * Stop scaling down when we've hit the limit. This also prevents
 	 * ->scale_step from going to crazy values, if the device can't
@@ -441,7 +498,7 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 		 * currently don't have a valid read/write sample. For that
 		 * case, slowly return to center state (step == 0).
 		 */
-		if (rwb->scale_step > 0)
+		if (rwb->scale_step > 0 || rwb->lowprio_step > 0)
 			scale_up(rwb);
 		else if (rwb->scale_step < 0)
 			scale_down(rwb, false);
@@ -453,13 +510,14 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	/*
 	 * Re-arm timer, if we have IO in flight
 	 */
-	if (rwb->scale_step || inflight)
+	if (rwb->scale_step || rwb->lowprio_step || inflight)
 		rwb_arm_timer(rwb);
 }
 
 void wbt_update_limits(struct rq_wb *rwb)
 {
 	rwb->scale_step = 0;
+	rwb->lowprio_step = 0;
 	rwb->scaled_max = false;
 	calc_wb_limits(rwb);
 
@@ -476,7 +534,8 @@ static bool close_io(struct rq_wb *rwb)
 
 #define REQ_HIPRIO	(REQ_SYNC | REQ_META | REQ_PRIO)
 
-static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
+static inline unsigned int get_limit(struct rq_wb *rwb,
+				     enum wbt_flags wb_acct, unsigned long rw)
 {
 	unsigned int limit;
 
@@ -499,11 +558,15 @@ static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
 	} else
 		limit = rwb->wb_normal;
 
+	if (wb_acct & WBT_LOWPRIO)
+		limit = min(limit, rwb->wb_lowprio);
+
 	return limit;
 }
 
 static inline bool may_queue(struct rq_wb *rwb, struct rq_wait *rqw,
-			     wait_queue_entry_t *wait, unsigned long rw)
+			     wait_queue_entry_t *wait, enum wbt_flags wb_acct,
+			     unsigned long rw)
 {
 	/*
 	 * inc it here even if disabled, since we'll dec it at completion.
@@ -523,28 +586,29 @@ static inline bool may_queue(struct rq_wb *rwb, struct rq_wait *rqw,
 	    rqw->wait.head.next != &wait->entry)
 		return false;
 
-	return atomic_inc_below(&rqw->inflight, get_limit(rwb, rw));
+	return atomic_inc_below(&rqw->inflight, get_limit(rwb, wb_acct, rw));
 }
 
 /*
  * Block if we will exceed our limit, or if we are currently waiting for
  * the timer to kick off queuing again.
  */
-static void __wbt_wait(struct rq_wb *rwb, unsigned long rw, spinlock_t *lock)
+static void __wbt_wait(struct rq_wb *rwb, enum wbt_flags wb_acct,
+		       unsigned long rw, spinlock_t *lock)
 	__releases(lock)
 	__acquires(lock)
 {
-	struct rq_wait *rqw = get_rq_wait(rwb, current_is_kswapd());
+	struct rq_wait *rqw = get_rq_wait(rwb, wb_acct);
 	DEFINE_WAIT(wait);
 
-	if (may_queue(rwb, rqw, &wait, rw))
+	if (may_queue(rwb, rqw, &wait, wb_acct, rw))
 		return;
 
 	do {
 		prepare_to_wait_exclusive(&rqw->wait, &wait,
 						TASK_UNINTERRUPTIBLE);
 
-		if (may_queue(rwb, rqw, &wait, rw))
+		if (may_queue(rwb, rqw, &wait, wb_acct, rw))
 			break;
 
 		if (lock) {
@@ -577,6 +641,30 @@ static inline bool wbt_should_throttle(struct rq_wb *rwb, struct bio *bio)
 	return true;
 }
 
+/*
+ * Writes that get the low priority budget: idle class I/O, and writes
+ * from a blkcg that isn't latency protected while others on this queue
+ * are.  RT writes never do.
+ */
+static bool wbt_is_lowprio(struct rq_wb *rwb, struct bio *bio)
+{
+	struct io_context *ioc = rq_ioc(bio);
+	u16 ioprio = bio_prio(bio);
+	int class;
+
+	/* Same fallback as the schedulers: ioprio_set() lands in the ioc */
+	if (!ioprio_valid(ioprio) && ioc)
+		ioprio = ioc->ioprio;
+	class = IOPRIO_PRIO_CLASS(ioprio);
+
+	if (class == IOPRIO_CLASS_IDLE)
+		return true;
+	if (class == IOPRIO_CLASS_RT)
+		return false;
+
+	return blk_iolatency_yields(rwb->queue, bio);
+}
+
 /*
  * Returns true if the IO request should be accounted, false if not.
  * May sleep, if we have exceeded the writeback limits. Caller can pass
@@ -599,14 +687,16 @@ enum wbt_flags wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
 		return ret;
 	}
 
-	__wbt_wait(rwb, bio->bi_opf, lock);
+	if (current_is_kswapd())
+		ret |= WBT_KSWAPD;
+	else if (wbt_is_lowprio(rwb, bio))
+		ret |= WBT_LOWPRIO;
+
+	__wbt_wait(rwb, ret, bio->bi_opf, lock);
 
 	if (!blk_stat_is_active(rwb->cb))
 		rwb_arm_timer(rwb);
 
-	if (current_is_kswapd())
-		ret |= WBT_KSWAPD;
-
 	return ret | WBT_TRACKED;
 }
 
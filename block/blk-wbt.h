@@ -14,12 +14,16 @@ enum wbt_flags {
 	WBT_TRACKED		= 1,	/* write, tracked for throttling */
 	WBT_READ		= 2,	/* read */
 	WBT_KSWAPD		= 4,	/* write, from kswapd */
+	WBT_LOWPRIO		= 8,	/* write, idle ioprio or unprotected blkcg */
 
-	WBT_NR_BITS		= 3,	/* number of bits */
+	WBT_NR_BITS		= 4,	/* number of bits */
 };
 
 enum {
-	WBT_NUM_RWQ		= 2,
+	WBT_RWQ_NORMAL		= 0,
+	WBT_RWQ_KSWAPD,
+	WBT_RWQ_LOWPRIO,
+	WBT_NUM_RWQ,
 };
 
 /*
@@ -68,7 +72,9 @@ struct rq_wb {
 	unsigned int wb_background;		/* background writeback */
 	unsigned int wb_normal;			/* normal writeback */
 	unsigned int wb_max;			/* max throughput writeback */
+	unsigned int wb_lowprio;		/* cap for WBT_LOWPRIO writes */
 	int scale_step;
+	int lowprio_step;			/* extra steps for WBT_LOWPRIO */
 	bool scaled_max;
 
 	short enable_state;			/* WBT_STATE_* */
@@ -347,6 +347,24 @@ static inline void blk_throtl_bio_endio(struct bio *bio) { }
 static inline void blk_throtl_stat_add(struct request *rq, u64 time) { }
 #endif
 
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+extern void blk_iolatency_bio_endio(struct bio *bio);
+extern bool blk_iolatency_protected(struct bio *bio);
+extern bool blk_iolatency_yields(struct request_queue *q, struct bio *bio);
+#else
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+static inline void blk_iolatency_bio_endio(struct bio *bio) { }
+static inline bool blk_iolatency_protected(struct bio *bio) { return false; }
+static inline bool blk_iolatency_yields(struct request_queue *q,
+					struct bio *bio)
+{
+	return false;
+}
+#endif
+
 #ifdef CONFIG_BOUNCE
 extern int init_emergency_isa_pool(void);
 extern void blk_queue_bounce(struct request_queue *q, struct bio **bio);
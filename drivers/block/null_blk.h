@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __BLK_NULL_BLK_H
+#define __BLK_NULL_BLK_H
+
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/blk-mq.h>
+#include <linux/hrtimer.h>
+#include <linux/configfs.h>
+#include <linux/radix-tree.h>
+#include <linux/spinlock.h>
+
+struct nullb_cmd {
+	struct list_head list;		/* on nullb_queue->poll_list */
+	struct request *rq;
+	struct nullb_queue *nq;
+	struct hrtimer timer;
+	u64 deadline;			/* polled completion, ktime ns */
+	bool reaped;			/* taken off poll_list by null_poll() */
+	blk_status_t error;
+};
+
+struct nullb_queue {
+	unsigned int queue_depth;
+	struct nullb_device *dev;
+
+	/* commands waiting for their deadline in irqmode=poll */
+	spinlock_t poll_lock;
+	struct list_head poll_list;
+};
+
+/*
+ * Completion modes: inline from ->queue_rq(), through the block softirq,
+ * from a per-command hrtimer, or reaped by blk_mq_poll().
+ */
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+	NULL_IRQ_POLL		= 3,
+};
+
+/* Distribution of the injected per-request latency */
+enum {
+	NULL_LAT_FIXED		= 0,	/* always completion_nsec */
+	NULL_LAT_UNIFORM	= 1,	/* uniform in [0, 2 * completion_nsec) */
+	NULL_LAT_EXPONENTIAL	= 2,	/* exponential, mean completion_nsec */
+};
+
+struct nullb_device {
+	struct nullb *nullb;
+	struct config_item item;
+	unsigned long flags;		/* NULLB_DEV_FL_* */
+
+	/* memory backing store, in PAGE_SIZE units */
+	struct radix_tree_root data;
+	spinlock_t data_lock;
+
+	/* zoned emulation */
+	unsigned int nr_zones;
+	struct blk_zone *zones;
+	sector_t zone_size_sects;
+	spinlock_t zone_lock;
+
+	unsigned long size;		/* device size in MB */
+	unsigned long completion_nsec;	/* mean injected latency */
+	unsigned int latency_dist;	/* NULL_LAT_* */
+	unsigned int submit_queues;	/* number of submission queues */
+	unsigned int home_node;		/* home node for the device */
+	unsigned int hw_queue_depth;	/* queue depth */
+	unsigned int index;		/* index of the disk, only valid with a disk */
+	unsigned int blocksize;		/* block size */
+	unsigned int irqmode;		/* NULL_IRQ_* */
+	unsigned int zone_size;		/* zone size in MB */
+	bool shared_tags;		/* share the tag set between devices */
+	bool memory_backed;		/* if data is stored in memory */
+	bool discard;			/* if support discard */
+	bool zoned;			/* if device is zoned */
+	bool power;			/* power on/off the device */
+};
+
+struct nullb {
+	struct nullb_device *dev;
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+	struct blk_mq_tag_set *tag_set;
+	struct blk_mq_tag_set __tag_set;
+	unsigned int queue_depth;
+
+	struct nullb_queue *queues;
+	unsigned int nr_queues;
+	char disk_name[DISK_NAME_LEN];
+};
+
+#ifdef CONFIG_BLK_DEV_ZONED
+int null_zone_init(struct nullb_device *dev);
+void null_zone_exit(struct nullb_device *dev);
+blk_status_t null_zone_report(struct nullb *nullb, struct nullb_cmd *cmd);
+blk_status_t null_zone_write(struct nullb_cmd *cmd);
+void null_zone_reset(struct nullb_cmd *cmd);
+#else
+static inline int null_zone_init(struct nullb_device *dev)
+{
+	return -EINVAL;
+}
+static inline void null_zone_exit(struct nullb_device *dev) {}
+static inline blk_status_t null_zone_report(struct nullb *nullb,
+					    struct nullb_cmd *cmd)
+{
+	return BLK_STS_NOTSUPP;
+}
+static inline blk_status_t null_zone_write(struct nullb_cmd *cmd)
+{
+	return BLK_STS_NOTSUPP;
+}
+static inline void null_zone_reset(struct nullb_cmd *cmd) {}
+#endif /* CONFIG_BLK_DEV_ZONED */
+#endif /* __BLK_NULL_BLK_H */
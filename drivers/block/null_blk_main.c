@@ -0,0 +1,1139 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Null or memory-backed block device, for measuring the block layer
+ * without real hardware in the way.
+ *
+ * A device has a configurable number of hardware queues and queue depth,
+ * can share its tag set with other devices, and completes requests inline,
+ * from the block softirq, from a per-request hrtimer or from blk_mq_poll().
+ * Timer and polled completions are delayed by an injected latency drawn
+ * from a fixed, uniform or exponential distribution.  Data can be kept in
+ * memory, and sequential-write-required zones can be emulated.
+ *
+ * Devices are created at load time from the module parameters, and at run
+ * time through configfs:
+ *
+ *	mkdir /sys/kernel/config/nullb/nullb1
+ *	echo 4 > /sys/kernel/config/nullb/nullb1/submit_queues
+ *	echo 3 > /sys/kernel/config/nullb/nullb1/irqmode
+ *	echo 1 > /sys/kernel/config/nullb/nullb1/power
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/highmem.h>
+#include <linux/random.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include "null_blk.h"
+
+#define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+#define PAGE_SECTORS		(1 << PAGE_SECTORS_SHIFT)
+#define SECTOR_MASK		(PAGE_SECTORS - 1)
+
+#define FREE_BATCH		16
+
+/*
+ * In irqmode=poll, requests nobody polls for (buffered I/O, or a poller
+ * that went to sleep) are completed by a timer this long after their
+ * deadline.
+ */
+#define NULL_POLL_FALLBACK_NSEC	(1 * NSEC_PER_MSEC)
+
+enum nullb_device_flags {
+	NULLB_DEV_FL_CONFIGURED	= 0,
+	NULLB_DEV_FL_UP		= 1,
+};
+
+static LIST_HEAD(nullb_list);
+static struct mutex lock;
+static int null_major;
+static DEFINE_IDA(nullb_indexes);
+static struct blk_mq_tag_set tag_set;
+
+static int g_submit_queues = 1;
+module_param_named(submit_queues, g_submit_queues, int, 0444);
+MODULE_PARM_DESC(submit_queues, "Number of submission queues");
+
+static int g_home_node = NUMA_NO_NODE;
+module_param_named(home_node, g_home_node, int, 0444);
+MODULE_PARM_DESC(home_node, "Home node for the device");
+
+static int g_gb = 250;
+module_param_named(gb, g_gb, int, 0444);
+MODULE_PARM_DESC(gb, "Size in GB");
+
+static int g_bs = 512;
+module_param_named(bs, g_bs, int, 0444);
+MODULE_PARM_DESC(bs, "Block size (in bytes)");
+
+static int nr_devices = 1;
+module_param(nr_devices, int, 0444);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int null_param_store_val(const char *str, int *val, int min, int max)
+{
+	int ret, new_val;
+
+	ret = kstrtoint(str, 10, &new_val);
+	if (ret)
+		return -EINVAL;
+
+	if (new_val < min || new_val > max)
+		return -EINVAL;
+
+	*val = new_val;
+	return 0;
+}
+
+static int g_irqmode = NULL_IRQ_SOFTIRQ;
+
+static int null_set_irqmode(const char *str, const struct kernel_param *kp)
+{
+	return null_param_store_val(str, &g_irqmode, NULL_IRQ_NONE,
+					NULL_IRQ_POLL);
+}
+
+static const struct kernel_param_ops null_irqmode_param_ops = {
+	.set	= null_set_irqmode,
+	.get	= param_get_int,
+};
+
+device_param_cb(irqmode, &null_irqmode_param_ops, &g_irqmode, 0444);
+MODULE_PARM_DESC(irqmode, "IRQ completion handler. 0-none, 1-softirq, 2-timer, 3-poll");
+
+static unsigned long g_completion_nsec = 10000;
+module_param_named(completion_nsec, g_completion_nsec, ulong, 0444);
+MODULE_PARM_DESC(completion_nsec, "Mean completion latency in ns for irqmode=2 and 3. Default: 10,000ns");
+
+static int g_latency_dist = NULL_LAT_FIXED;
+
+static int null_set_latency_dist(const char *str, const struct kernel_param *kp)
+{
+	return null_param_store_val(str, &g_latency_dist, NULL_LAT_FIXED,
+					NULL_LAT_EXPONENTIAL);
+}
+
+static const struct kernel_param_ops null_latency_dist_param_ops = {
+	.set	= null_set_latency_dist,
+	.get	= param_get_int,
+};
+
+device_param_cb(latency_dist, &null_latency_dist_param_ops, &g_latency_dist, 0444);
+MODULE_PARM_DESC(latency_dist, "Completion latency distribution. 0-fixed, 1-uniform, 2-exponential");
+
+static int g_hw_queue_depth = 64;
+module_param_named(hw_queue_depth, g_hw_queue_depth, int, 0444);
+MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: 64");
+
+static bool g_shared_tags;
+module_param_named(shared_tags, g_shared_tags, bool, 0444);
+MODULE_PARM_DESC(shared_tags, "Share tag set between devices");
+
+static bool g_memory_backed;
+module_param_named(memory_backed, g_memory_backed, bool, 0444);
+MODULE_PARM_DESC(memory_backed, "Keep written data in memory. Default: false");
+
+static bool g_discard;
+module_param_named(discard, g_discard, bool, 0444);
+MODULE_PARM_DESC(discard, "Support discard operations (requires memory-backed). Default: false");
+
+static bool g_zoned;
+module_param_named(zoned, g_zoned, bool, 0444);
+MODULE_PARM_DESC(zoned, "Make device as a host-managed zoned block device. Default: false");
+
+static unsigned long g_zone_size = 256;
+module_param_named(zone_size, g_zone_size, ulong, 0444);
+MODULE_PARM_DESC(zone_size, "Zone size in MB when block device is zoned. Must be power-of-two: Default: 256");
+
+static int null_add_dev(struct nullb_device *dev);
+static void null_del_dev(struct nullb *nullb);
+static void null_free_device_storage(struct nullb_device *dev);
+
+static inline struct nullb_device *to_nullb_device(struct config_item *item)
+{
+	return item ? container_of(item, struct nullb_device, item) : NULL;
+}
+
+static inline ssize_t nullb_device_uint_attr_show(unsigned int val, char *page)
+{
+	return snprintf(page, PAGE_SIZE, "%u\n", val);
+}
+
+static inline ssize_t nullb_device_ulong_attr_show(unsigned long val,
+	char *page)
+{
+	return snprintf(page, PAGE_SIZE, "%lu\n", val);
+}
+
+static inline ssize_t nullb_device_bool_attr_show(bool val, char *page)
+{
+	return snprintf(page, PAGE_SIZE, "%u\n", val);
+}
+
+static ssize_t nullb_device_uint_attr_store(unsigned int *val,
+	const char *page, size_t count)
+{
+	unsigned int tmp;
+	int result;
+
+	result = kstrtouint(page, 0, &tmp);
+	if (result)
+		return result;
+
+	*val = tmp;
+	return count;
+}
+
+static ssize_t nullb_device_ulong_attr_store(unsigned long *val,
+	const char *page, size_t count)
+{
+	int result;
+	unsigned long tmp;
+
+	result = kstrtoul(page, 0, &tmp);
+	if (result)
+		return result;
+
+	*val = tmp;
+	return count;
+}
+
+static ssize_t nullb_device_bool_attr_store(bool *val, const char *page,
+	size_t count)
+{
+	bool tmp;
+	int result;
+
+	result = kstrtobool(page,  &tmp);
+	if (result)
+		return result;
+
+	*val = tmp;
+	return count;
+}
+
+/* The following macro should only be used with TYPE = {uint, ulong, bool}. */
+#define NULLB_DEVICE_ATTR(NAME, TYPE)					\
+static ssize_t								\
+nullb_device_##NAME##_show(struct config_item *item, char *page)	\
+{									\
+	return nullb_device_##TYPE##_attr_show(				\
+				to_nullb_device(item)->NAME, page);	\
+}									\
+static ssize_t								\
+nullb_device_##NAME##_store(struct config_item *item, const char *page,	\
+			    size_t count)				\
+{									\
+	if (test_bit(NULLB_DEV_FL_CONFIGURED, &to_nullb_device(item)->flags)) \
+		return -EBUSY;						\
+	return nullb_device_##TYPE##_attr_store(			\
+			&to_nullb_device(item)->NAME, page, count);	\
+}									\
+CONFIGFS_ATTR(nullb_device_, NAME);
+
+NULLB_DEVICE_ATTR(size, ulong);
+NULLB_DEVICE_ATTR(completion_nsec, ulong);
+NULLB_DEVICE_ATTR(latency_dist, uint);
+NULLB_DEVICE_ATTR(submit_queues, uint);
+NULLB_DEVICE_ATTR(home_node, uint);
+NULLB_DEVICE_ATTR(hw_queue_depth, uint);
+NULLB_DEVICE_ATTR(index, uint);
+NULLB_DEVICE_ATTR(blocksize, uint);
+NULLB_DEVICE_ATTR(irqmode, uint);
+NULLB_DEVICE_ATTR(shared_tags, bool);
+NULLB_DEVICE_ATTR(memory_backed, bool);
+NULLB_DEVICE_ATTR(discard, bool);
+NULLB_DEVICE_ATTR(zoned, bool);
+NULLB_DEVICE_ATTR(zone_size, uint);
+
+static ssize_t nullb_device_power_show(struct config_item *item, char *page)
+{
+	return nullb_device_bool_attr_show(to_nullb_device(item)->power, page);
+}
+
+static ssize_t nullb_device_power_store(struct config_item *item,
+				     const char *page, size_t count)
+{
+	struct nullb_device *dev = to_nullb_device(item);
+	bool newp = false;
+	ssize_t ret;
+	int err;
+
+	ret = nullb_device_bool_attr_store(&newp, page, count);
+	if (ret < 0)
+		return ret;
+
+	if (!dev->power && newp) {
+		if (test_and_set_bit(NULLB_DEV_FL_UP, &dev->flags))
+			return count;
+		set_bit(NULLB_DEV_FL_CONFIGURED, &dev->flags);
+		err = null_add_dev(dev);
+		if (err) {
+			clear_bit(NULLB_DEV_FL_CONFIGURED, &dev->flags);
+			clear_bit(NULLB_DEV_FL_UP, &dev->flags);
+			return err;
+		}
+
+		dev->power = newp;
+	} else if (dev->power && !newp) {
+		mutex_lock(&lock);
+		dev->power = newp;
+		null_del_dev(dev->nullb);
+		mutex_unlock(&lock);
+		clear_bit(NULLB_DEV_FL_UP, &dev->flags);
+		clear_bit(NULLB_DEV_FL_CONFIGURED, &dev->flags);
+	}
+
+	return count;
+}
+
+CONFIGFS_ATTR(nullb_device_, power);
+
+static struct configfs_attribute *nullb_device_attrs[] = {
+	&nullb_device_attr_size,
+	&nullb_device_attr_completion_nsec,
+	&nullb_device_attr_latency_dist,
+	&nullb_device_attr_submit_queues,
+	&nullb_device_attr_home_node,
+	&nullb_device_attr_hw_queue_depth,
+	&nullb_device_attr_index,
+	&nullb_device_attr_blocksize,
+	&nullb_device_attr_irqmode,
+	&nullb_device_attr_shared_tags,
+	&nullb_device_attr_memory_backed,
+	&nullb_device_attr_discard,
+	&nullb_device_attr_zoned,
+	&nullb_device_attr_zone_size,
+	&nullb_device_attr_power,
+	NULL,
+};
+
+static void nullb_device_release(struct config_item *item)
+{
+	struct nullb_device *dev = to_nullb_device(item);
+
+	null_free_device_storage(dev);
+	kfree(dev);
+}
+
+static struct configfs_item_operations nullb_device_ops = {
+	.release	= nullb_device_release,
+};
+
+static struct config_item_type nullb_device_type = {
+	.ct_item_ops	= &nullb_device_ops,
+	.ct_attrs	= nullb_device_attrs,
+	.ct_owner	= THIS_MODULE,
+};
+
+static struct nullb_device *null_alloc_dev(void)
+{
+	struct nullb_device *dev;
+
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (!dev)
+		return NULL;
+	INIT_RADIX_TREE(&dev->data, GFP_ATOMIC);
+	spin_lock_init(&dev->data_lock);
+
+	dev->size = g_gb * 1024;
+	dev->completion_nsec = g_completion_nsec;
+	dev->latency_dist = g_latency_dist;
+	dev->submit_queues = g_submit_queues;
+	dev->home_node = g_home_node;
+	dev->hw_queue_depth = g_hw_queue_depth;
+	dev->blocksize = g_bs;
+	dev->irqmode = g_irqmode;
+	dev->shared_tags = g_shared_tags;
+	dev->memory_backed = g_memory_backed;
+	dev->discard = g_discard;
+	dev->zoned = g_zoned;
+	dev->zone_size = g_zone_size;
+	return dev;
+}
+
+static void null_free_dev(struct nullb_device *dev)
+{
+	null_free_device_storage(dev);
+	kfree(dev);
+}
+
+static struct
+config_item *nullb_group_make_item(struct config_group *group, const char *name)
+{
+	struct nullb_device *dev;
+
+	dev = null_alloc_dev();
+	if (!dev)
+		return ERR_PTR(-ENOMEM);
+
+	config_item_init_type_name(&dev->item, name, &nullb_device_type);
+
+	return &dev->item;
+}
+
+static void
+nullb_group_drop_item(struct config_group *group, struct config_item *item)
+{
+	struct nullb_device *dev = to_nullb_device(item);
+
+	if (test_and_clear_bit(NULLB_DEV_FL_UP, &dev->flags)) {
+		mutex_lock(&lock);
+		dev->power = false;
+		null_del_dev(dev->nullb);
+		mutex_unlock(&lock);
+	}
+
+	config_item_put(item);
+}
+
+static ssize_t memb_group_features_show(struct config_item *item, char *page)
+{
+	return snprintf(page, PAGE_SIZE,
+			"memory_backed,discard,shared_tags,latency_dist,poll,zoned,zone_size\n");
+}
+
+CONFIGFS_ATTR_RO(memb_group_, features);
+
+static struct configfs_attribute *nullb_group_attrs[] = {
+	&memb_group_attr_features,
+	NULL,
+};
+
+static struct configfs_group_operations nullb_group_ops = {
+	.make_item	= nullb_group_make_item,
+	.drop_item	= nullb_group_drop_item,
+};
+
+static struct config_item_type nullb_group_type = {
+	.ct_group_ops	= &nullb_group_ops,
+	.ct_attrs	= nullb_group_attrs,
+	.ct_owner	= THIS_MODULE,
+};
+
+static struct configfs_subsystem nullb_subsys = {
+	.su_group = {
+		.cg_item = {
+			.ci_namebuf = "nullb",
+			.ci_type = &nullb_group_type,
+		},
+	},
+};
+
+/*
+ * Exponentially distributed latency with the given mean: -ln(u) for u
+ * uniform in (0, 1], with log2(u) taken as its integer part plus a linear
+ * approximation of the mantissa, in 16.16 fixed point.
+ */
+static u64 null_exp_latency(u64 mean)
+{
+	u32 u = prandom_u32() | 1;
+	int l = ilog2(u);
+	u64 log2u, neg_log2u;
+
+	log2u = ((u64)l << 16) + ((((u64)u << 16) >> l) & 0xffff);
+	neg_log2u = (32ULL << 16) - log2u;
+
+	/* ln 2 is 45426 in 16.16 */
+	return mul_u64_u32_shr(mean, (neg_log2u * 45426) >> 16, 16);
+}
+
+static u64 null_cmd_latency(struct nullb_device *dev)
+{
+	u64 mean = dev->completion_nsec;
+
+	switch (dev->latency_dist) {
+	case NULL_LAT_UNIFORM:
+		return mul_u64_u32_shr(2 * mean, prandom_u32(), 32);
+	case NULL_LAT_EXPONENTIAL:
+		return null_exp_latency(mean);
+	default:
+		return mean;
+	}
+}
+
+static void end_cmd(struct nullb_cmd *cmd)
+{
+	blk_mq_end_request(cmd->rq, cmd->error);
+}
+
+static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+{
+	struct nullb_cmd *cmd = container_of(timer, struct nullb_cmd, timer);
+	struct nullb_queue *nq = cmd->nq;
+
+	if (nq->dev->irqmode == NULL_IRQ_POLL) {
+		spin_lock(&nq->poll_lock);
+		/* reaped by null_poll(), which waits for us to return */
+		if (cmd->reaped) {
+			spin_unlock(&nq->poll_lock);
+			return HRTIMER_NORESTART;
+		}
+		list_del_init(&cmd->list);
+		spin_unlock(&nq->poll_lock);
+	}
+
+	end_cmd(cmd);
+
+	return HRTIMER_NORESTART;
+}
+
+static void null_cmd_start_timer(struct nullb_cmd *cmd, u64 nsec)
+{
+	hrtimer_init(&cmd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cmd->timer.function = null_cmd_timer_expired;
+	hrtimer_start(&cmd->timer, ns_to_ktime(nsec), HRTIMER_MODE_REL);
+}
+
+static void null_cmd_queue_poll(struct nullb_cmd *cmd, u64 nsec)
+{
+	struct nullb_queue *nq = cmd->nq;
+	unsigned long flags;
+
+	cmd->deadline = ktime_get_ns() + nsec;
+	cmd->reaped = false;
+
+	spin_lock_irqsave(&nq->poll_lock, flags);
+	list_add_tail(&cmd->list, &nq->poll_list);
+	spin_unlock_irqrestore(&nq->poll_lock, flags);
+
+	null_cmd_start_timer(cmd, nsec + NULL_POLL_FALLBACK_NSEC);
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	end_cmd(blk_mq_rq_to_pdu(rq));
+}
+
+static int null_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	struct nullb_queue *nq = hctx->driver_data;
+	struct nullb_cmd *cmd, *tmp;
+	u64 now = ktime_get_ns();
+	LIST_HEAD(done);
+	int found = 0;
+
+	spin_lock_irq(&nq->poll_lock);
+	list_for_each_entry_safe(cmd, tmp, &nq->poll_list, list) {
+		if (cmd->deadline <= now) {
+			cmd->reaped = true;
+			list_move_tail(&cmd->list, &done);
+		}
+	}
+	spin_unlock_irq(&nq->poll_lock);
+
+	list_for_each_entry_safe(cmd, tmp, &done, list) {
+		list_del_init(&cmd->list);
+		/*
+		 * A fallback timer that already fired backs off on ->reaped;
+		 * make sure it is done before the request can be reused.
+		 */
+		hrtimer_cancel(&cmd->timer);
+
+		if (cmd->rq->tag == tag)
+			found = 1;
+		end_cmd(cmd);
+	}
+
+	return found;
+}
+
+static struct page *null_lookup_page(struct nullb_device *dev, sector_t sector)
+{
+	return radix_tree_lookup(&dev->data, sector >> PAGE_SECTORS_SHIFT);
+}
+
+static struct page *null_insert_page(struct nullb_device *dev, sector_t sector)
+{
+	pgoff_t idx = sector >> PAGE_SECTORS_SHIFT;
+	struct page *page, *new;
+
+	spin_lock_irq(&dev->data_lock);
+	page = radix_tree_lookup(&dev->data, idx);
+	spin_unlock_irq(&dev->data_lock);
+	if (page)
+		return page;
+
+	new = alloc_page(GFP_NOIO | __GFP_ZERO);
+	if (!new)
+		return NULL;
+	if (radix_tree_preload(GFP_NOIO)) {
+		__free_page(new);
+		return NULL;
+	}
+
+	spin_lock_irq(&dev->data_lock);
+	page = radix_tree_lookup(&dev->data, idx);
+	if (!page) {
+		new->index = idx;
+		WARN_ON_ONCE(radix_tree_insert(&dev->data, idx, new));
+		page = new;
+		new = NULL;
+	}
+	spin_unlock_irq(&dev->data_lock);
+	radix_tree_preload_end();
+
+	if (new)
+		__free_page(new);
+	return page;
+}
+
+static blk_status_t null_transfer(struct nullb_device *dev, struct page *page,
+				  unsigned int len, unsigned int off,
+				  bool is_write, sector_t sector)
+{
+	unsigned int offset = (sector & SECTOR_MASK) << SECTOR_SHIFT;
+	struct page *store;
+	void *dst, *src;
+
+	if (is_write) {
+		store = null_insert_page(dev, sector);
+		if (!store)
+			return BLK_STS_RESOURCE;
+	}
+
+	/* discard may free the backing page */
+	spin_lock_irq(&dev->data_lock);
+	store = null_lookup_page(dev, sector);
+	if (is_write && store) {
+		src = kmap_atomic(page);
+		dst = kmap_atomic(store);
+		memcpy(dst + offset, src + off, len);
+		kunmap_atomic(dst);
+		kunmap_atomic(src);
+	} else if (!is_write) {
+		dst = kmap_atomic(page);
+		if (store) {
+			src = kmap_atomic(store);
+			memcpy(dst + off, src + offset, len);
+			kunmap_atomic(src);
+		} else {
+			memset(dst + off, 0, len);
+		}
+		flush_dcache_page(page);
+		kunmap_atomic(dst);
+	}
+	spin_unlock_irq(&dev->data_lock);
+
+	return BLK_STS_OK;
+}
+
+static blk_status_t null_handle_rq(struct nullb_cmd *cmd)
+{
+	struct request *rq = cmd->rq;
+	struct nullb_device *dev = cmd->nq->dev;
+	bool is_write = op_is_write(req_op(rq));
+	struct req_iterator iter;
+	struct bio_vec bvec;
+	blk_status_t err;
+
+	rq_for_each_segment(bvec, rq, iter) {
+		sector_t sector = iter.iter.bi_sector;
+		unsigned int len = bvec.bv_len;
+		unsigned int off = bvec.bv_offset;
+
+		while (len) {
+			unsigned int chunk = min_t(unsigned int, len,
+				PAGE_SIZE - ((sector & SECTOR_MASK) << SECTOR_SHIFT));
+
+			err = null_transfer(dev, bvec.bv_page, chunk, off,
+					    is_write, sector);
+			if (err)
+				return err;
+			len -= chunk;
+			off += chunk;
+			sector += chunk >> SECTOR_SHIFT;
+		}
+	}
+
+	return BLK_STS_OK;
+}
+
+static void null_handle_discard(struct nullb_device *dev, sector_t sector,
+				unsigned int nr_sectors)
+{
+	sector_t end = sector + nr_sectors;
+	struct page *page;
+
+	/* only pages entirely covered by the discard are dropped */
+	sector = round_up(sector, PAGE_SECTORS);
+	end = round_down(end, PAGE_SECTORS);
+
+	spin_lock_irq(&dev->data_lock);
+	for (; sector < end; sector += PAGE_SECTORS) {
+		page = radix_tree_delete(&dev->data,
+					 sector >> PAGE_SECTORS_SHIFT);
+		if (page)
+			__free_page(page);
+	}
+	spin_unlock_irq(&dev->data_lock);
+}
+
+static void null_free_device_storage(struct nullb_device *dev)
+{
+	struct page *pages[FREE_BATCH];
+	unsigned long pos = 0;
+	int nr_pages, i;
+
+	do {
+		nr_pages = radix_tree_gang_lookup(&dev->data, (void **)pages,
+						  pos, FREE_BATCH);
+		for (i = 0; i < nr_pages; i++) {
+			pos = pages[i]->index;
+			radix_tree_delete(&dev->data, pos);
+			__free_page(pages[i]);
+		}
+		pos++;
+	} while (nr_pages == FREE_BATCH);
+}
+
+static blk_status_t null_handle_cmd(struct nullb_cmd *cmd)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	struct request *rq = cmd->rq;
+
+	switch (req_op(rq)) {
+	case REQ_OP_ZONE_REPORT:
+		cmd->error = null_zone_report(dev->nullb, cmd);
+		break;
+	case REQ_OP_ZONE_RESET:
+		null_zone_reset(cmd);
+		break;
+	case REQ_OP_DISCARD:
+		if (dev->memory_backed)
+			null_handle_discard(dev, blk_rq_pos(rq),
+					    blk_rq_sectors(rq));
+		break;
+	case REQ_OP_WRITE:
+		if (dev->zoned) {
+			cmd->error = null_zone_write(cmd);
+			if (cmd->error)
+				break;
+		}
+		/* fall through */
+	case REQ_OP_READ:
+		if (dev->memory_backed)
+			cmd->error = null_handle_rq(cmd);
+		break;
+	default:
+		break;
+	}
+
+	switch (dev->irqmode) {
+	case NULL_IRQ_SOFTIRQ:
+		blk_mq_complete_request(rq);
+		break;
+	case NULL_IRQ_NONE:
+		end_cmd(cmd);
+		break;
+	case NULL_IRQ_TIMER:
+		null_cmd_start_timer(cmd, null_cmd_latency(dev));
+		break;
+	case NULL_IRQ_POLL:
+		null_cmd_queue_poll(cmd, null_cmd_latency(dev));
+		break;
+	}
+
+	return BLK_STS_OK;
+}
+
+static blk_status_t null_queue_rq(struct blk_mq_hw_ctx *hctx,
+			 const struct blk_mq_queue_data *bd)
+{
+	struct nullb_cmd *cmd = blk_mq_rq_to_pdu(bd->rq);
+	struct nullb_queue *nq = hctx->driver_data;
+
+	might_sleep_if(hctx->flags & BLK_MQ_F_BLOCKING);
+
+	INIT_LIST_HEAD(&cmd->list);
+	cmd->rq = bd->rq;
+	cmd->nq = nq;
+	cmd->error = BLK_STS_OK;
+
+	blk_mq_start_request(bd->rq);
+
+	return null_handle_cmd(cmd);
+}
+
+static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
+{
+	BUG_ON(!nullb);
+	BUG_ON(!nq);
+
+	nq->queue_depth = nullb->queue_depth;
+	nq->dev = nullb->dev;
+	spin_lock_init(&nq->poll_lock);
+	INIT_LIST_HEAD(&nq->poll_list);
+}
+
+static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			  unsigned int index)
+{
+	/* queuedata is set before the queue is initialized, see null_add_dev() */
+	struct nullb *nullb = hctx->queue->queuedata;
+	struct nullb_queue *nq = &nullb->queues[index];
+
+	hctx->driver_data = nq;
+	null_init_queue(nullb, nq);
+	nullb->nr_queues++;
+
+	return 0;
+}
+
+static const struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+	.complete	= null_softirq_done_fn,
+	.poll		= null_poll,
+	.init_hctx	= null_init_hctx,
+};
+
+static void cleanup_queues(struct nullb *nullb)
+{
+	kfree(nullb->queues);
+}
+
+static void null_del_dev(struct nullb *nullb)
+{
+	struct nullb_device *dev = nullb->dev;
+
+	ida_simple_remove(&nullb_indexes, nullb->index);
+
+	list_del_init(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	if (nullb->tag_set == &nullb->__tag_set)
+		blk_mq_free_tag_set(nullb->tag_set);
+	put_disk(nullb->disk);
+	cleanup_queues(nullb);
+	if (dev->zoned)
+		null_zone_exit(dev);
+	kfree(nullb);
+	dev->nullb = NULL;
+}
+
+static int null_open(struct block_device *bdev, fmode_t mode)
+{
+	return 0;
+}
+
+static void null_release(struct gendisk *disk, fmode_t mode)
+{
+}
+
+static const struct block_device_operations null_fops = {
+	.owner =	THIS_MODULE,
+	.open =		null_open,
+	.release =	null_release,
+};
+
+static int setup_queues(struct nullb *nullb)
+{
+	nullb->queues = kcalloc(nullb->tag_set->nr_hw_queues,
+				sizeof(struct nullb_queue), GFP_KERNEL);
+	if (!nullb->queues)
+		return -ENOMEM;
+
+	nullb->nr_queues = 0;
+	nullb->queue_depth = nullb->tag_set->queue_depth;
+
+	return 0;
+}
+
+static void null_config_discard(struct nullb *nullb)
+{
+	if (nullb->dev->discard == false)
+		return;
+	nullb->q->limits.discard_granularity = nullb->dev->blocksize;
+	nullb->q->limits.discard_alignment = nullb->dev->blocksize;
+	blk_queue_max_discard_sectors(nullb->q, UINT_MAX >> 9);
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, nullb->q);
+}
+
+static int null_gendisk_register(struct nullb *nullb)
+{
+	struct gendisk *disk;
+	sector_t size;
+
+	disk = nullb->disk = alloc_disk_node(1, nullb->dev->home_node);
+	if (!disk)
+		return -ENOMEM;
+	if (nullb->dev->zoned)
+		size = (sector_t)nullb->dev->nr_zones *
+			nullb->dev->zone_size_sects;
+	else
+		size = (sector_t)nullb->dev->size * 1024 * 1024ULL;
+	set_capacity(disk, size >> 9);
+
+	disk->flags |= GENHD_FL_EXT_DEVT | GENHD_FL_SUPPRESS_PARTITION_INFO;
+	disk->major		= null_major;
+	disk->first_minor	= nullb->index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	strncpy(disk->disk_name, nullb->disk_name, DISK_NAME_LEN);
+
+	device_add_disk(NULL, disk);
+	return 0;
+}
+
+static int null_init_tag_set(struct nullb *nullb, struct blk_mq_tag_set *set)
+{
+	set->ops = &null_mq_ops;
+	set->nr_hw_queues = nullb ? nullb->dev->submit_queues :
+						g_submit_queues;
+	set->queue_depth = nullb ? nullb->dev->hw_queue_depth :
+						g_hw_queue_depth;
+	set->numa_node = nullb ? nullb->dev->home_node : g_home_node;
+	set->cmd_size	= sizeof(struct nullb_cmd);
+	set->flags = BLK_MQ_F_SHOULD_MERGE;
+	/* the memory backing store allocates pages in ->queue_rq() */
+	if (nullb ? nullb->dev->memory_backed : g_memory_backed)
+		set->flags |= BLK_MQ_F_BLOCKING;
+	set->driver_data = NULL;
+
+	return blk_mq_alloc_tag_set(set);
+}
+
+/*
+ * The shared tag set is created by the first device that asks for it,
+ * from the module parameters, and lives until the module is unloaded.
+ * Called with the lock held.
+ */
+static int null_get_shared_tag_set(struct nullb *nullb)
+{
+	int ret;
+
+	if (!tag_set.ops) {
+		ret = null_init_tag_set(NULL, &tag_set);
+		if (ret) {
+			tag_set.ops = NULL;
+			return ret;
+		}
+	}
+
+	if (!!(tag_set.flags & BLK_MQ_F_BLOCKING) != nullb->dev->memory_backed) {
+		pr_err("null_blk: memory_backed must match the shared tag set\n");
+		return -EINVAL;
+	}
+
+	nullb->tag_set = &tag_set;
+	return 0;
+}
+
+static void null_validate_conf(struct nullb_device *dev)
+{
+	dev->blocksize = round_down(dev->blocksize, 512);
+	dev->blocksize = clamp_t(unsigned int, dev->blocksize, 512, 4096);
+
+	if (dev->submit_queues > nr_cpu_ids)
+		dev->submit_queues = nr_cpu_ids;
+	else if (dev->submit_queues == 0)
+		dev->submit_queues = 1;
+
+	dev->hw_queue_depth = clamp_t(unsigned int, dev->hw_queue_depth, 1,
+				      BLK_MQ_MAX_DEPTH);
+
+	if (dev->irqmode > NULL_IRQ_POLL)
+		dev->irqmode = NULL_IRQ_SOFTIRQ;
+	if (dev->latency_dist > NULL_LAT_EXPONENTIAL)
+		dev->latency_dist = NULL_LAT_FIXED;
+
+	/* discard only drops pages of the backing store */
+	dev->discard = dev->discard && dev->memory_backed;
+}
+
+static int null_add_dev(struct nullb_device *dev)
+{
+	struct request_queue *q;
+	struct nullb *nullb;
+	int rv;
+
+	null_validate_conf(dev);
+
+	nullb = kzalloc_node(sizeof(*nullb), GFP_KERNEL, dev->home_node);
+	if (!nullb) {
+		rv = -ENOMEM;
+		goto out;
+	}
+	nullb->dev = dev;
+	dev->nullb = nullb;
+
+	if (dev->shared_tags) {
+		mutex_lock(&lock);
+		rv = null_get_shared_tag_set(nullb);
+		mutex_unlock(&lock);
+	} else {
+		nullb->tag_set = &nullb->__tag_set;
+		rv = null_init_tag_set(nullb, nullb->tag_set);
+	}
+	if (rv)
+		goto out_free_nullb;
+
+	rv = setup_queues(nullb);
+	if (rv)
+		goto out_cleanup_tags;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, dev->home_node);
+	if (!q) {
+		rv = -ENOMEM;
+		goto out_cleanup_queues;
+	}
+	q->queuedata = nullb;
+	nullb->q = blk_mq_init_allocated_queue(nullb->tag_set, q);
+	if (IS_ERR(nullb->q)) {
+		blk_cleanup_queue(q);
+		rv = -ENOMEM;
+		goto out_cleanup_queues;
+	}
+
+	if (dev->zoned) {
+		rv = null_zone_init(dev);
+		if (rv)
+			goto out_cleanup_blk_queue;
+
+		blk_queue_chunk_sectors(nullb->q, dev->zone_size_sects);
+		nullb->q->limits.zoned = BLK_ZONED_HM;
+	}
+
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, nullb->q);
+
+	mutex_lock(&lock);
+	rv = ida_simple_get(&nullb_indexes, 0, 0, GFP_KERNEL);
+	mutex_unlock(&lock);
+	if (rv < 0)
+		goto out_cleanup_zone;
+	nullb->index = rv;
+	dev->index = nullb->index;
+
+	blk_queue_logical_block_size(nullb->q, dev->blocksize);
+	blk_queue_physical_block_size(nullb->q, dev->blocksize);
+
+	null_config_discard(nullb);
+
+	sprintf(nullb->disk_name, "nullb%d", nullb->index);
+
+	rv = null_gendisk_register(nullb);
+	if (rv)
+		goto out_ida_remove;
+
+	mutex_lock(&lock);
+	list_add_tail(&nullb->list, &nullb_list);
+	mutex_unlock(&lock);
+
+	return 0;
+out_ida_remove:
+	ida_simple_remove(&nullb_indexes, nullb->index);
+out_cleanup_zone:
+	if (dev->zoned)
+		null_zone_exit(dev);
+out_cleanup_blk_queue:
+	blk_cleanup_queue(nullb->q);
+out_cleanup_queues:
+	cleanup_queues(nullb);
+out_cleanup_tags:
+	if (nullb->tag_set == &nullb->__tag_set)
+		blk_mq_free_tag_set(nullb->tag_set);
+out_free_nullb:
+	kfree(nullb);
+	dev->nullb = NULL;
+out:
+	return rv;
+}
+
+static int __init null_init(void)
+{
+	int ret = 0;
+	unsigned int i;
+	struct nullb *nullb;
+	struct nullb_device *dev;
+
+	if (g_bs > PAGE_SIZE) {
+		pr_warn("null_blk: invalid block size\n");
+		pr_warn("null_blk: defaults block size to %lu\n", PAGE_SIZE);
+		g_bs = PAGE_SIZE;
+	}
+
+	if (g_submit_queues > nr_cpu_ids)
+		g_submit_queues = nr_cpu_ids;
+	else if (g_submit_queues <= 0)
+		g_submit_queues = 1;
+
+	config_group_init(&nullb_subsys.su_group);
+	mutex_init(&nullb_subsys.su_mutex);
+
+	ret = configfs_register_subsystem(&nullb_subsys);
+	if (ret)
+		return ret;
+
+	mutex_init(&lock);
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0) {
+		ret = null_major;
+		goto err_conf;
+	}
+
+	for (i = 0; i < nr_devices; i++) {
+		dev = null_alloc_dev();
+		if (!dev) {
+			ret = -ENOMEM;
+			goto err_dev;
+		}
+		ret = null_add_dev(dev);
+		if (ret) {
+			null_free_dev(dev);
+			goto err_dev;
+		}
+	}
+
+	pr_info("null_blk: module loaded\n");
+	return 0;
+
+err_dev:
+	while (!list_empty(&nullb_list)) {
+		nullb = list_entry(nullb_list.next, struct nullb, list);
+		dev = nullb->dev;
+		null_del_dev(nullb);
+		null_free_dev(dev);
+	}
+	unregister_blkdev(null_major, "nullb");
+err_conf:
+	configfs_unregister_subsystem(&nullb_subsys);
+	if (tag_set.ops)
+		blk_mq_free_tag_set(&tag_set);
+	return ret;
+}
+
+static void __exit null_exit(void)
+{
+	struct nullb *nullb;
+
+	configfs_unregister_subsystem(&nullb_subsys);
+
+	unregister_blkdev(null_major, "nullb");
+
+	mutex_lock(&lock);
+	while (!list_empty(&nullb_list)) {
+		struct nullb_device *dev;
+
+		nullb = list_entry(nullb_list.next, struct nullb, list);
+		dev = nullb->dev;
+		null_del_dev(nullb);
+		null_free_dev(dev);
+	}
+	mutex_unlock(&lock);
+
+	if (tag_set.ops)
+		blk_mq_free_tag_set(&tag_set);
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_DESCRIPTION("Null and memory-backed block device for benchmarking");
+MODULE_LICENSE("GPL");
@@ -1033,6 +1033,43 @@ static ssize_t use_dedup_store(struct device *dev,
 }
 #endif
 
+#ifdef CONFIG_ZRAM_ZONED
+static ssize_t zone_size_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	u64 val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->zone_size;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%llu\n", val);
+}
+
+static ssize_t zone_size_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	u64 zone_size;
+	struct zram *zram = dev_to_zram(dev);
+
+	zone_size = memparse(buf, NULL);
+	if (zone_size && (!is_power_of_2(zone_size) ||
+			  zone_size < PAGE_SIZE))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change zone size for initialized device\n");
+		return -EBUSY;
+	}
+	zram->zone_size = zone_size;
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -1293,6 +1330,13 @@ static void zram_free_page(struct zram *zram, size_t index)
 		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB));
 }
 
+void zram_slot_free(struct zram *zram, u32 index)
+{
+	zram_slot_lock(zram, index);
+	zram_free_page(zram, index);
+	zram_slot_unlock(zram, index);
+}
+
 static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 				struct bio *bio, bool partial_io)
 {
@@ -1649,9 +1693,16 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 	switch (bio_op(bio)) {
 	case REQ_OP_DISCARD:
 	case REQ_OP_WRITE_ZEROES:
+		if (zram_zoned(zram))
+			goto out;
 		zram_bio_discard(zram, index, offset, bio);
 		bio_endio(bio);
 		return;
+	case REQ_OP_WRITE:
+		if (zram_zone_write(zram, bio->bi_iter.bi_sector,
+				    bio_sectors(bio)))
+			goto out;
+		break;
 	default:
 		break;
 	}
@@ -1687,6 +1738,19 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 static blk_qc_t zram_make_request(struct request_queue *queue, struct bio *bio)
 {
 	struct zram *zram = queue->queuedata;
+	int ret;
+
+	/* Zone commands carry a report buffer or nothing at all */
+	switch (bio_op(bio)) {
+	case REQ_OP_ZONE_REPORT:
+		ret = zram_zone_report(zram, bio);
+		goto zone_done;
+	case REQ_OP_ZONE_RESET:
+		ret = zram_zone_reset(zram, bio->bi_iter.bi_sector);
+		goto zone_done;
+	default:
+		break;
+	}
 
 	if (!valid_io_request(zram, bio->bi_iter.bi_sector,
 					bio->bi_iter.bi_size)) {
@@ -1697,6 +1761,11 @@ static blk_qc_t zram_make_request(struct request_queue *queue, struct bio *bio)
 	__zram_make_request(zram, bio);
 	return BLK_QC_T_NONE;
 
+zone_done:
+	if (!ret) {
+		bio_endio(bio);
+		return BLK_QC_T_NONE;
+	}
 error:
 	bio_io_error(bio);
 	return BLK_QC_T_NONE;
@@ -1737,6 +1806,11 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 		goto out;
 	}
 
+	if (is_write && zram_zone_write(zram, sector, SECTORS_PER_PAGE)) {
+		ret = -EIO;
+		goto out;
+	}
+
 	index = sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = (sector & (SECTORS_PER_PAGE - 1)) << SECTOR_SHIFT;
 
@@ -1794,6 +1868,7 @@ static void zram_reset_device(struct zram *zram)
 	up_write(&zram->init_lock);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
+	zram_zone_fini(zram);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
 	reset_bdev(zram);
@@ -1824,12 +1899,16 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_unlock;
 	}
 
+	err = zram_zone_init(zram, disksize);
+	if (err)
+		goto out_free_meta;
+
 	comp = zcomp_create(zram->compressor);
 	if (IS_ERR(comp)) {
 		pr_err("Cannot initialise %s compressing backend\n",
 				zram->compressor);
 		err = PTR_ERR(comp);
-		goto out_free_meta;
+		goto out_free_zones;
 	}
 
 	zram->comp = comp;
@@ -1841,6 +1920,8 @@ static ssize_t disksize_store(struct device *dev,
 
 	return len;
 
+out_free_zones:
+	zram_zone_fini(zram);
 out_free_meta:
 	zram_meta_free(zram, disksize);
 out_unlock:
@@ -1935,6 +2016,9 @@ static DEVICE_ATTR_RW(use_dedup);
 #else
 static DEVICE_ATTR_RO(use_dedup);
 #endif
+#ifdef CONFIG_ZRAM_ZONED
+static DEVICE_ATTR_RW(zone_size);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -1953,6 +2037,9 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_writeback_limit_enable.attr,
 #endif
 	&dev_attr_use_dedup.attr,
+#ifdef CONFIG_ZRAM_ZONED
+	&dev_attr_zone_size.attr,
+#endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
 #ifdef CONFIG_ZRAM_WRITEBACK
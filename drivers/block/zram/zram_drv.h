@@ -22,6 +22,7 @@
 
 #include "zcomp.h"
 #include "zram_dedup.h"
+#include "zram_zoned.h"
 
 #define SECTORS_PER_PAGE_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
@@ -148,6 +149,13 @@ struct zram {
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
 #endif
+#ifdef CONFIG_ZRAM_ZONED
+	u64 zone_size;	/* bytes, 0 for a conventional device */
+	sector_t zone_size_sects;
+	unsigned int nr_zones;
+	struct blk_zone *zones;
+	spinlock_t zone_lock;
+#endif
 };
 
 static inline bool zram_dedup_enabled(struct zram *zram)
@@ -159,5 +167,15 @@ static inline bool zram_dedup_enabled(struct zram *zram)
 #endif
 }
 
+static inline bool zram_zoned(struct zram *zram)
+{
+#ifdef CONFIG_ZRAM_ZONED
+	return zram->zones;
+#else
+	return false;
+#endif
+}
+
 void zram_entry_free(struct zram *zram, struct zram_entry *entry);
+void zram_slot_free(struct zram *zram, u32 index);
 #endif
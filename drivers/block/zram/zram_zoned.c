@@ -0,0 +1,212 @@
+/*
+ * Zoned block device emulation for zram.
+ *
+ * Every zone is sequential-write-required: writes must land on the zone
+ * write pointer, and a zone reset drops all compressed objects stored in
+ * the zone at once. This suits log-structured users (e.g. f2fs in zoned
+ * mode) which never overwrite in place and would otherwise pay for the
+ * per-slot free on each rewrite plus a separate discard pass.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/blkdev.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+
+#include "zram_drv.h"
+
+static inline unsigned int zram_zone_no(struct zram *zram, sector_t sector)
+{
+	return sector >> ilog2(zram->zone_size_sects);
+}
+
+int zram_zone_init(struct zram *zram, u64 disksize)
+{
+	struct request_queue *q = zram->disk->queue;
+	sector_t sector = 0;
+	unsigned int i;
+
+	if (!zram->zone_size)
+		return 0;
+
+	if (disksize < zram->zone_size || disksize & (zram->zone_size - 1)) {
+		pr_info("disksize must be a multiple of zone_size\n");
+		return -EINVAL;
+	}
+
+	zram->zone_size_sects = zram->zone_size >> SECTOR_SHIFT;
+	zram->nr_zones = disksize >> ilog2(zram->zone_size);
+	zram->zones = kvmalloc_array(zram->nr_zones, sizeof(struct blk_zone),
+				     GFP_KERNEL | __GFP_ZERO);
+	if (!zram->zones)
+		return -ENOMEM;
+	spin_lock_init(&zram->zone_lock);
+
+	for (i = 0; i < zram->nr_zones; i++) {
+		struct blk_zone *zone = &zram->zones[i];
+
+		zone->start = zone->wp = sector;
+		zone->len = zram->zone_size_sects;
+		zone->type = BLK_ZONE_TYPE_SEQWRITE_REQ;
+		zone->cond = BLK_ZONE_COND_EMPTY;
+
+		sector += zram->zone_size_sects;
+	}
+
+	/* Space is given back by zone reset, not discard */
+	queue_flag_clear_unlocked(QUEUE_FLAG_DISCARD, q);
+	blk_queue_max_write_zeroes_sectors(q, 0);
+	blk_queue_chunk_sectors(q, zram->zone_size_sects);
+	q->limits.zoned = BLK_ZONED_HM;
+
+	return 0;
+}
+
+void zram_zone_fini(struct zram *zram)
+{
+	struct request_queue *q = zram->disk->queue;
+
+	if (!zram->zones)
+		return;
+
+	q->limits.zoned = BLK_ZONED_NONE;
+	q->limits.chunk_sectors = 0;
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
+	if (ZRAM_LOGICAL_BLOCK_SIZE == PAGE_SIZE)
+		blk_queue_max_write_zeroes_sectors(q, UINT_MAX);
+
+	kvfree(zram->zones);
+	zram->zones = NULL;
+	zram->nr_zones = 0;
+}
+
+int zram_zone_report(struct zram *zram, struct bio *bio)
+{
+	struct blk_zone_report_hdr *hdr = NULL;
+	unsigned int zno, nr_zones, zones_to_cpy;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	void *addr, *p;
+
+	if (!zram->zones)
+		return -EOPNOTSUPP;
+
+	zno = zram_zone_no(zram, bio->bi_iter.bi_sector);
+	nr_zones = zno < zram->nr_zones ? zram->nr_zones - zno : 0;
+	nr_zones = min_t(unsigned int, nr_zones,
+			 bio->bi_iter.bi_size / sizeof(struct blk_zone) - 1);
+
+	bio_for_each_segment(bvec, bio, iter) {
+		addr = kmap_atomic(bvec.bv_page);
+		p = addr + bvec.bv_offset;
+
+		zones_to_cpy = bvec.bv_len / sizeof(struct blk_zone);
+
+		if (!hdr) {
+			hdr = p;
+			hdr->nr_zones = nr_zones;
+			zones_to_cpy--;
+			p += sizeof(struct blk_zone_report_hdr);
+		}
+
+		zones_to_cpy = min_t(unsigned int, zones_to_cpy, nr_zones);
+
+		spin_lock(&zram->zone_lock);
+		memcpy(p, &zram->zones[zno],
+		       zones_to_cpy * sizeof(struct blk_zone));
+		spin_unlock(&zram->zone_lock);
+
+		kunmap_atomic(addr);
+
+		nr_zones -= zones_to_cpy;
+		zno += zones_to_cpy;
+
+		if (!nr_zones)
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Writes must start at the zone write pointer and must not cross into
+ * the next zone. The write pointer is advanced before the data is stored,
+ * so a failed write leaves it past the hole, as on real zoned media.
+ */
+int zram_zone_write(struct zram *zram, sector_t sector, unsigned int nr_sects)
+{
+	struct blk_zone *zone;
+	int ret = 0;
+
+	if (!zram->zones)
+		return 0;
+
+	zone = &zram->zones[zram_zone_no(zram, sector)];
+
+	spin_lock(&zram->zone_lock);
+	switch (zone->cond) {
+	case BLK_ZONE_COND_EMPTY:
+	case BLK_ZONE_COND_IMP_OPEN:
+		if (sector != zone->wp ||
+		    zone->wp + nr_sects > zone->start + zone->len) {
+			ret = -EIO;
+			break;
+		}
+
+		if (zone->cond == BLK_ZONE_COND_EMPTY)
+			zone->cond = BLK_ZONE_COND_IMP_OPEN;
+
+		zone->wp += nr_sects;
+		if (zone->wp == zone->start + zone->len)
+			zone->cond = BLK_ZONE_COND_FULL;
+		break;
+	default:
+		/* Full zone */
+		ret = -EIO;
+		break;
+	}
+	spin_unlock(&zram->zone_lock);
+
+	return ret;
+}
+
+/*
+ * Only the slots below the write pointer can hold data, so the reset
+ * releases exactly those and never walks the untouched tail of the zone.
+ */
+int zram_zone_reset(struct zram *zram, sector_t sector)
+{
+	struct blk_zone *zone;
+	u32 index, end;
+
+	if (!zram->zones)
+		return -EOPNOTSUPP;
+
+	if (sector & (zram->zone_size_sects - 1) ||
+	    zram_zone_no(zram, sector) >= zram->nr_zones)
+		return -EINVAL;
+
+	zone = &zram->zones[zram_zone_no(zram, sector)];
+
+	spin_lock(&zram->zone_lock);
+	index = zone->start >> SECTORS_PER_PAGE_SHIFT;
+	end = DIV_ROUND_UP(zone->wp, SECTORS_PER_PAGE);
+	spin_unlock(&zram->zone_lock);
+
+	for (; index < end; index++)
+		zram_slot_free(zram, index);
+
+	spin_lock(&zram->zone_lock);
+	zone->wp = zone->start;
+	zone->cond = BLK_ZONE_COND_EMPTY;
+	spin_unlock(&zram->zone_lock);
+
+	return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef _ZRAM_ZONED_H_
+#define _ZRAM_ZONED_H_
+
+struct zram;
+struct bio;
+
+#ifdef CONFIG_ZRAM_ZONED
+
+int zram_zone_init(struct zram *zram, u64 disksize);
+void zram_zone_fini(struct zram *zram);
+
+int zram_zone_report(struct zram *zram, struct bio *bio);
+int zram_zone_write(struct zram *zram, sector_t sector, unsigned int nr_sects);
+int zram_zone_reset(struct zram *zram, sector_t sector);
+#else
+
+static inline int zram_zone_init(struct zram *zram,
+			u64 disksize) { return 0; }
+static inline void zram_zone_fini(struct zram *zram) { }
+
+static inline int zram_zone_report(struct zram *zram,
+			struct bio *bio) { return -EOPNOTSUPP; }
+static inline int zram_zone_write(struct zram *zram, sector_t sector,
+			unsigned int nr_sects) { return 0; }
+static inline int zram_zone_reset(struct zram *zram,
+			sector_t sector) { return -EOPNOTSUPP; }
+
+#endif
+
+#endif /* _ZRAM_ZONED_H_ */
@@ -93,6 +93,8 @@
  */
 struct dm_bufio_client {
 	struct mutex lock;
+	spinlock_t spinlock;
+	bool no_sleep;
 
 	struct list_head lru[LIST_SIZE];
 	unsigned long n_buffers[LIST_SIZE];
@@ -189,19 +191,39 @@ static inline int dm_bufio_cache_index(struct dm_bufio_client *c)
 
 #define dm_bufio_in_request()	(!!current->bio_list)
 
+/*
+ * Clients created with DM_BUFIO_CLIENT_NO_SLEEP use a spinlock instead of
+ * the mutex so that dm_bufio_get() and dm_bufio_release() can be called
+ * from softirq context.  Nothing may sleep with the lock held for them:
+ * buffers with I/O in flight are skipped instead of waited for.
+ */
 static void dm_bufio_lock(struct dm_bufio_client *c)
 {
-	mutex_lock_nested(&c->lock, dm_bufio_in_request());
+	if (c->no_sleep)
+		spin_lock_bh(&c->spinlock);
+	else
+		mutex_lock_nested(&c->lock, dm_bufio_in_request());
 }
 
 static int dm_bufio_trylock(struct dm_bufio_client *c)
 {
+	if (c->no_sleep)
+		return spin_trylock_bh(&c->spinlock);
 	return mutex_trylock(&c->lock);
 }
 
 static void dm_bufio_unlock(struct dm_bufio_client *c)
 {
-	mutex_unlock(&c->lock);
+	if (c->no_sleep)
+		spin_unlock_bh(&c->spinlock);
+	else
+		mutex_unlock(&c->lock);
+}
+
+static void dm_bufio_cond_resched(struct dm_bufio_client *c)
+{
+	if (!c->no_sleep)
+		cond_resched();
 }
 
 /*----------------------------------------------------------------*/
@@ -784,23 +806,29 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 		BUG_ON(test_bit(B_WRITING, &b->state));
 		BUG_ON(test_bit(B_DIRTY, &b->state));
 
+		if (c->no_sleep && unlikely(b->state))
+			continue;
+
 		if (!b->hold_count) {
 			__make_buffer_clean(b);
 			__unlink_buffer(b);
 			return b;
 		}
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 
 	list_for_each_entry_reverse(b, &c->lru[LIST_DIRTY], lru_list) {
 		BUG_ON(test_bit(B_READING, &b->state));
 
+		if (c->no_sleep && unlikely(b->state))
+			continue;
+
 		if (!b->hold_count) {
 			__make_buffer_clean(b);
 			__unlink_buffer(b);
 			return b;
 		}
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 
 	return NULL;
@@ -943,7 +971,7 @@ static void __write_dirty_buffers_async(struct dm_bufio_client *c, int no_wait,
 			return;
 
 		__write_dirty_buffer(b, write_list);
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 }
 
@@ -995,7 +1023,7 @@ static void __check_watermark(struct dm_bufio_client *c,
 			return;
 
 		__free_buffer_wake(b);
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 
 	if (c->n_buffers[LIST_DIRTY] > threshold_buffers)
@@ -1113,7 +1141,8 @@ static void *new_read(struct dm_bufio_client *c, sector_t block,
 #endif
 	dm_bufio_unlock(c);
 
-	__flush_write_list(&write_list);
+	if (!list_empty(&write_list))
+		__flush_write_list(&write_list);
 
 	if (!b)
 		return NULL;
@@ -1121,7 +1150,12 @@ static void *new_read(struct dm_bufio_client *c, sector_t block,
 	if (need_submit)
 		submit_io(b, READ, read_endio);
 
-	wait_on_bit_io(&b->state, B_READING, TASK_UNINTERRUPTIBLE);
+	/*
+	 * NF_GET never returns a buffer that is still being read, and
+	 * dm_bufio_get() must not sleep for DM_BUFIO_CLIENT_NO_SLEEP clients.
+	 */
+	if (nf != NF_GET)
+		wait_on_bit_io(&b->state, B_READING, TASK_UNINTERRUPTIBLE);
 
 	if (b->read_error) {
 		int error = blk_status_to_errno(b->read_error);
@@ -1331,7 +1365,7 @@ int dm_bufio_write_dirty_buffers(struct dm_bufio_client *c)
 		    !test_bit(B_WRITING, &b->state))
 			__relink_lru(b, LIST_CLEAN);
 
-		cond_resched();
+		dm_bufio_cond_resched(c);
 
 		/*
 		 * If we dropped the lock, the list is no longer consistent,
@@ -1542,6 +1576,28 @@ static void drop_buffers(struct dm_bufio_client *c)
 
 	dm_bufio_lock(c);
 
+	/*
+	 * __get_unclaimed_buffer skips buffers that are being read for
+	 * DM_BUFIO_CLIENT_NO_SLEEP clients, so wait for those reads here.
+	 */
+	while (c->no_sleep) {
+		bool reading = false;
+
+		list_for_each_entry(b, &c->lru[LIST_CLEAN], lru_list)
+			if (test_bit(B_READING, &b->state)) {
+				reading = true;
+				break;
+			}
+		if (!reading)
+			break;
+
+		b->hold_count++;
+		dm_bufio_unlock(c);
+		wait_on_bit_io(&b->state, B_READING, TASK_UNINTERRUPTIBLE);
+		dm_bufio_release(b);
+		dm_bufio_lock(c);
+	}
+
 	while ((b = __get_unclaimed_buffer(c)))
 		__free_buffer_wake(b);
 
@@ -1578,7 +1634,7 @@ static void drop_buffers(struct dm_bufio_client *c)
  */
 static bool __try_evict_buffer(struct dm_buffer *b, gfp_t gfp)
 {
-	if (!(gfp & __GFP_FS)) {
+	if (!(gfp & __GFP_FS) || b->c->no_sleep) {
 		if (test_bit(B_READING, &b->state) ||
 		    test_bit(B_WRITING, &b->state) ||
 		    test_bit(B_DIRTY, &b->state))
@@ -1617,7 +1673,7 @@ static unsigned long __scan(struct dm_bufio_client *c, unsigned long nr_to_scan,
 				freed++;
 			if (!--nr_to_scan || ((count - freed) <= retain_target))
 				return freed;
-			cond_resched();
+			dm_bufio_cond_resched(c);
 		}
 	}
 	return freed;
@@ -1657,7 +1713,8 @@ dm_bufio_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsigned block_size,
 					       unsigned reserved_buffers, unsigned aux_size,
 					       void (*alloc_callback)(struct dm_buffer *),
-					       void (*write_callback)(struct dm_buffer *))
+					       void (*write_callback)(struct dm_buffer *),
+					       unsigned int flags)
 {
 	int r;
 	struct dm_bufio_client *c;
@@ -1691,6 +1748,8 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 	}
 
 	mutex_init(&c->lock);
+	spin_lock_init(&c->spinlock);
+	c->no_sleep = flags & DM_BUFIO_CLIENT_NO_SLEEP;
 	INIT_LIST_HEAD(&c->reserved_buffers);
 	c->need_reserved_buffers = reserved_buffers;
 
@@ -1860,7 +1919,7 @@ static void __evict_old_buffers(struct dm_bufio_client *c, unsigned long age_hz)
 		if (__try_evict_buffer(b, 0))
 			count--;
 
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 
 	dm_bufio_unlock(c);
@@ -19,11 +19,13 @@
 #include <linux/slab.h>
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
+#include <linux/interrupt.h>
 #include <linux/kthread.h>
 #include <linux/backing-dev.h>
 #include <linux/atomic.h>
 #include <linux/scatterlist.h>
 #include <linux/rbtree.h>
+#include <linux/llist.h>
 #include <linux/ctype.h>
 #include <asm/page.h>
 #include <asm/unaligned.h>
@@ -51,6 +53,7 @@ struct convert_context {
 	struct bvec_iter iter_out;
 	atomic_t cc_pending;
 	u64 cc_sector;
+	unsigned int tag_offset;
 	union {
 		struct skcipher_request *req;
 		struct aead_request *req_aead;
@@ -67,6 +70,7 @@ struct dm_crypt_io {
 	u8 *integrity_metadata;
 	bool integrity_metadata_from_pool;
 	struct work_struct work;
+	struct llist_node tasklet_node;	/* on kcryptd_tasklets */
 
 	struct convert_context ctx;
 
@@ -126,11 +130,14 @@ struct iv_tcw_private {
  */
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
 	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD,
-	     DM_CRYPT_ENCRYPT_OVERRIDE };
+	     DM_CRYPT_ENCRYPT_OVERRIDE,
+	     DM_CRYPT_NO_READ_WORKQUEUE,
+	     DM_CRYPT_NO_WRITE_WORKQUEUE };
 
 enum cipher_flags {
 	CRYPT_MODE_INTEGRITY_AEAD,	/* Use authenticated mode for cihper */
 	CRYPT_IV_LARGE_SECTORS,		/* Calculate IV from sector_size, not 512B sectors */
+	CRYPT_SYNC_CIPHER,		/* Cipher never completes asynchronously */
 };
 
 /*
@@ -1013,6 +1020,7 @@ static void crypt_convert_init(struct crypt_config *cc,
 	if (bio_out)
 		ctx->iter_out = bio_out->bi_iter;
 	ctx->cc_sector = sector + cc->iv_offset;
+	ctx->tag_offset = 0;
 	init_completion(&ctx->restart);
 }
 
@@ -1246,13 +1254,17 @@ static int crypt_convert_block_skcipher(struct crypt_config *cc,
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
 
-static void crypt_alloc_req_skcipher(struct crypt_config *cc,
-				     struct convert_context *ctx)
+static int crypt_alloc_req_skcipher(struct crypt_config *cc,
+				    struct convert_context *ctx)
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
 
-	if (!ctx->r.req)
-		ctx->r.req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!ctx->r.req) {
+		ctx->r.req = mempool_alloc(cc->req_pool, in_interrupt() ?
+					   GFP_ATOMIC : GFP_NOIO);
+		if (!ctx->r.req)
+			return -ENOMEM;
+	}
 
 	skcipher_request_set_tfm(ctx->r.req, cc->cipher_tfm.tfms[key_index]);
 
@@ -1263,13 +1275,19 @@ static void crypt_alloc_req_skcipher(struct crypt_config *cc,
 	skcipher_request_set_callback(ctx->r.req,
 	    CRYPTO_TFM_REQ_MAY_BACKLOG,
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req));
+
+	return 0;
 }
 
-static void crypt_alloc_req_aead(struct crypt_config *cc,
-				 struct convert_context *ctx)
+static int crypt_alloc_req_aead(struct crypt_config *cc,
+				struct convert_context *ctx)
 {
-	if (!ctx->r.req_aead)
-		ctx->r.req_aead = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!ctx->r.req_aead) {
+		ctx->r.req_aead = mempool_alloc(cc->req_pool, in_interrupt() ?
+						GFP_ATOMIC : GFP_NOIO);
+		if (!ctx->r.req_aead)
+			return -ENOMEM;
+	}
 
 	aead_request_set_tfm(ctx->r.req_aead, cc->cipher_tfm.tfms_aead[0]);
 
@@ -1280,15 +1298,21 @@ static void crypt_alloc_req_aead(struct crypt_config *cc,
 	aead_request_set_callback(ctx->r.req_aead,
 	    CRYPTO_TFM_REQ_MAY_BACKLOG,
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req_aead));
+
+	return 0;
 }
 
-static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+/*
+ * Reads may be decrypted from softirq context (no_read_workqueue), where
+ * the mempool must not sleep: the allocation may fail there instead.
+ */
+static int crypt_alloc_req(struct crypt_config *cc,
+			   struct convert_context *ctx)
 {
 	if (crypt_integrity_aead(cc))
-		crypt_alloc_req_aead(cc, ctx);
+		return crypt_alloc_req_aead(cc, ctx);
 	else
-		crypt_alloc_req_skcipher(cc, ctx);
+		return crypt_alloc_req_skcipher(cc, ctx);
 }
 
 static void crypt_free_req_skcipher(struct crypt_config *cc,
@@ -1319,25 +1343,30 @@ static void crypt_free_req(struct crypt_config *cc, void *req, struct bio *base_
 
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
+ *
+ * Returns BLK_STS_RESOURCE if a request could not be allocated in interrupt
+ * context; calling again with @reset_pending false resumes the conversion.
  */
 static blk_status_t crypt_convert(struct crypt_config *cc,
-			 struct convert_context *ctx)
+			 struct convert_context *ctx, bool atomic,
+			 bool reset_pending)
 {
-	unsigned int tag_offset = 0;
 	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
 	int r;
 
-	atomic_set(&ctx->cc_pending, 1);
+	if (reset_pending)
+		atomic_set(&ctx->cc_pending, 1);
 
 	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
 
-		crypt_alloc_req(cc, ctx);
+		if (crypt_alloc_req(cc, ctx))
+			return BLK_STS_RESOURCE;
 		atomic_inc(&ctx->cc_pending);
 
 		if (crypt_integrity_aead(cc))
-			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead, tag_offset);
+			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead, ctx->tag_offset);
 		else
-			r = crypt_convert_block_skcipher(cc, ctx, ctx->r.req, tag_offset);
+			r = crypt_convert_block_skcipher(cc, ctx, ctx->r.req, ctx->tag_offset);
 
 		switch (r) {
 		/*
@@ -1355,7 +1384,7 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		case -EINPROGRESS:
 			ctx->r.req = NULL;
 			ctx->cc_sector += sector_step;
-			tag_offset++;
+			ctx->tag_offset++;
 			continue;
 		/*
 		 * The request was already processed (synchronously).
@@ -1363,8 +1392,9 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		case 0:
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector += sector_step;
-			tag_offset++;
-			cond_resched();
+			ctx->tag_offset++;
+			if (!atomic)
+				cond_resched();
 			continue;
 		/*
 		 * There was a data integrity error.
@@ -1677,6 +1707,25 @@ static int dmcrypt_write(void *data)
 	return 0;
 }
 
+/*
+ * With no_read_workqueue / no_write_workqueue the bio is processed in the
+ * context that hands it to us instead of bouncing through kcryptd.  This is
+ * only done for synchronous ciphers: an async one may return -EBUSY and
+ * make us sleep, so those keep using the workqueues.
+ */
+static bool kcryptd_crypt_inline(struct dm_crypt_io *io)
+{
+	struct crypt_config *cc = io->cc;
+
+	if (!test_bit(CRYPT_SYNC_CIPHER, &cc->cipher_flags))
+		return false;
+
+	if (bio_data_dir(io->base_bio) == READ)
+		return test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+
+	return test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+}
+
 static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 {
 	struct bio *clone = io->ctx.bio_out;
@@ -1697,7 +1746,8 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_iter.bi_sector = cc->start + io->sector;
 
-	if (likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+	if (likely(!async) && (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags) ||
+			       kcryptd_crypt_inline(io))) {
 		generic_make_request(clone);
 		return;
 	}
@@ -1752,7 +1802,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	sector += bio_sectors(clone);
 
 	crypt_inc_pending(io);
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, false, true);
 	if (r)
 		io->error = r;
 	crypt_finished = atomic_dec_and_test(&io->ctx.cc_pending);
@@ -1772,6 +1822,22 @@ static void kcryptd_crypt_read_done(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
+static void kcryptd_crypt_read_continue(struct work_struct *work)
+{
+	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
+	struct crypt_config *cc = io->cc;
+	blk_status_t r;
+
+	r = crypt_convert(cc, &io->ctx, false, false);
+	if (r)
+		io->error = r;
+
+	if (atomic_dec_and_test(&io->ctx.cc_pending))
+		kcryptd_crypt_read_done(io);
+
+	crypt_dec_pending(io);
+}
+
 static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
@@ -1782,7 +1848,16 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
 
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, kcryptd_crypt_inline(io), true);
+	/*
+	 * No request could be allocated without sleeping in the completion
+	 * context: finish the remaining sectors from kcryptd.
+	 */
+	if (r == BLK_STS_RESOURCE) {
+		INIT_WORK(&io->work, kcryptd_crypt_read_continue);
+		queue_work(cc->crypt_queue, &io->work);
+		return;
+	}
 	if (r)
 		io->error = r;
 
@@ -1841,10 +1916,51 @@ static void kcryptd_crypt(struct work_struct *work)
 		kcryptd_crypt_write_convert(io);
 }
 
+/*
+ * Reads completed in hard irq context are decrypted from a per-cpu tasklet.
+ * The tasklet must not live in the io: finishing the read ends the bio and
+ * frees the io, while tasklet_action() still uses the tasklet afterwards.
+ */
+struct kcryptd_tasklet {
+	struct llist_head list;
+	struct tasklet_struct tasklet;
+};
+
+static DEFINE_PER_CPU(struct kcryptd_tasklet, kcryptd_tasklets);
+
+static void kcryptd_crypt_tasklet(unsigned long data)
+{
+	struct kcryptd_tasklet *kt = (struct kcryptd_tasklet *)data;
+	struct llist_node *node;
+	struct dm_crypt_io *io, *tmp;
+
+	node = llist_reverse_order(llist_del_all(&kt->list));
+	llist_for_each_entry_safe(io, tmp, node, tasklet_node)
+		kcryptd_crypt(&io->work);
+}
+
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
 
+	if (kcryptd_crypt_inline(io)) {
+		/*
+		 * The skcipher walk must not run in hard irq context, so a
+		 * read completed from there is finished in a tasklet on this
+		 * CPU.  Softirq and process context decrypt in place.
+		 */
+		if (in_irq() || irqs_disabled()) {
+			struct kcryptd_tasklet *kt = this_cpu_ptr(&kcryptd_tasklets);
+
+			llist_add(&io->tasklet_node, &kt->list);
+			tasklet_schedule(&kt->tasklet);
+			return;
+		}
+
+		kcryptd_crypt(&io->work);
+		return;
+	}
+
 	INIT_WORK(&io->work, kcryptd_crypt);
 	queue_work(cc->crypt_queue, &io->work);
 }
@@ -1888,6 +2004,32 @@ static void crypt_free_tfms(struct crypt_config *cc)
 		crypt_free_tfms_skcipher(cc);
 }
 
+/*
+ * Inline processing needs a synchronous cipher, so prefer one of those
+ * when it was asked for and fall back to whatever is available.
+ */
+static bool crypt_wants_sync_tfm(struct crypt_config *cc)
+{
+	return test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags) ||
+	       test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+}
+
+static bool crypt_tfms_sync(struct crypt_config *cc)
+{
+	unsigned i;
+
+	if (crypt_integrity_aead(cc))
+		return !(crypto_aead_alg(any_tfm_aead(cc))->base.cra_flags &
+			 CRYPTO_ALG_ASYNC);
+
+	for (i = 0; i < cc->tfms_count; i++)
+		if (crypto_skcipher_alg(cc->cipher_tfm.tfms[i])->base.cra_flags &
+		    CRYPTO_ALG_ASYNC)
+			return false;
+
+	return true;
+}
+
 static int crypt_alloc_tfms_skcipher(struct crypt_config *cc, char *ciphermode)
 {
 	unsigned i;
@@ -1899,7 +2041,12 @@ static int crypt_alloc_tfms_skcipher(struct crypt_config *cc, char *ciphermode)
 		return -ENOMEM;
 
 	for (i = 0; i < cc->tfms_count; i++) {
-		cc->cipher_tfm.tfms[i] = crypto_alloc_skcipher(ciphermode, 0, 0);
+		cc->cipher_tfm.tfms[i] = ERR_PTR(-ENOENT);
+		if (crypt_wants_sync_tfm(cc))
+			cc->cipher_tfm.tfms[i] = crypto_alloc_skcipher(ciphermode, 0,
+								       CRYPTO_ALG_ASYNC);
+		if (IS_ERR(cc->cipher_tfm.tfms[i]))
+			cc->cipher_tfm.tfms[i] = crypto_alloc_skcipher(ciphermode, 0, 0);
 		if (IS_ERR(cc->cipher_tfm.tfms[i])) {
 			err = PTR_ERR(cc->cipher_tfm.tfms[i]);
 			crypt_free_tfms(cc);
@@ -1925,7 +2072,12 @@ static int crypt_alloc_tfms_aead(struct crypt_config *cc, char *ciphermode)
 	if (!cc->cipher_tfm.tfms)
 		return -ENOMEM;
 
-	cc->cipher_tfm.tfms_aead[0] = crypto_alloc_aead(ciphermode, 0, 0);
+	cc->cipher_tfm.tfms_aead[0] = ERR_PTR(-ENOENT);
+	if (crypt_wants_sync_tfm(cc))
+		cc->cipher_tfm.tfms_aead[0] = crypto_alloc_aead(ciphermode, 0,
+								CRYPTO_ALG_ASYNC);
+	if (IS_ERR(cc->cipher_tfm.tfms_aead[0]))
+		cc->cipher_tfm.tfms_aead[0] = crypto_alloc_aead(ciphermode, 0, 0);
 	if (IS_ERR(cc->cipher_tfm.tfms_aead[0])) {
 		err = PTR_ERR(cc->cipher_tfm.tfms_aead[0]);
 		crypt_free_tfms(cc);
@@ -2629,7 +2781,7 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 	struct crypt_config *cc = ti->private;
 	struct dm_arg_set as;
 	static const struct dm_arg _args[] = {
-		{0, 6, "Invalid number of feature args"},
+		{0, 8, "Invalid number of feature args"},
 	};
 	unsigned int opt_params, val;
 	const char *opt_string, *sval;
@@ -2659,6 +2811,10 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 
 		else if (!strcasecmp(opt_string, "submit_from_crypt_cpus"))
 			set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		else if (!strcasecmp(opt_string, "no_read_workqueue"))
+			set_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		else if (!strcasecmp(opt_string, "no_write_workqueue"))
+			set_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
 		else if (sscanf(opt_string, "integrity:%u:", &val) == 1) {
 			if (val == 0 || val > MAX_TAG_SIZE) {
 				ti->error = "Invalid integrity arguments";
@@ -2757,6 +2913,11 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	if (ret < 0)
 		goto bad;
 
+	if (crypt_tfms_sync(cc))
+		set_bit(CRYPT_SYNC_CIPHER, &cc->cipher_flags);
+	else if (crypt_wants_sync_tfm(cc))
+		DMINFO("asynchronous cipher, using workqueues for crypto");
+
 	if (crypt_integrity_aead(cc)) {
 		cc->dmreq_start = sizeof(struct aead_request);
 		cc->dmreq_start += crypto_aead_reqsize(any_tfm_aead(cc));
@@ -3002,6 +3163,8 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		num_feature_args += !!ti->num_discard_bios;
 		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
 		num_feature_args += cc->sector_size != (1 << SECTOR_SHIFT);
 		num_feature_args += test_bit(CRYPT_IV_LARGE_SECTORS, &cc->cipher_flags);
 		num_feature_args += test_bit(DM_CRYPT_ENCRYPT_OVERRIDE,
@@ -3016,6 +3179,10 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 				DMEMIT(" same_cpu_crypt");
 			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
 				DMEMIT(" submit_from_crypt_cpus");
+			if (test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_read_workqueue");
+			if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_write_workqueue");
 			if (cc->on_disk_tag_size)
 				DMEMIT(" integrity:%u:%s", cc->on_disk_tag_size, cc->cipher_auth);
 			if (cc->sector_size != (1 << SECTOR_SHIFT))
@@ -3135,7 +3302,7 @@ static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 18, 1},
+	.version = {1, 19, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -3151,7 +3318,15 @@ static struct target_type crypt_target = {
 
 static int __init dm_crypt_init(void)
 {
-	int r;
+	int cpu, r;
+
+	for_each_possible_cpu(cpu) {
+		struct kcryptd_tasklet *kt = per_cpu_ptr(&kcryptd_tasklets, cpu);
+
+		init_llist_head(&kt->list);
+		tasklet_init(&kt->tasklet, kcryptd_crypt_tasklet,
+			     (unsigned long)kt);
+	}
 
 	r = dm_register_target(&crypt_target);
 	if (r < 0)
@@ -3162,7 +3337,12 @@ static int __init dm_crypt_init(void)
 
 static void __exit dm_crypt_exit(void)
 {
+	int cpu;
+
 	dm_unregister_target(&crypt_target);
+
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu_ptr(&kcryptd_tasklets, cpu)->tasklet);
 }
 
 module_init(dm_crypt_init);
@@ -33,8 +33,9 @@
 #define DM_VERITY_OPT_RESTART		"restart_on_corruption"
 #define DM_VERITY_OPT_IGN_ZEROES	"ignore_zero_blocks"
 #define DM_VERITY_OPT_AT_MOST_ONCE	"check_at_most_once"
+#define DM_VERITY_OPT_TASKLET_VERIFY	"try_verify_in_tasklet"
 
-#define DM_VERITY_OPTS_MAX		(2 + DM_VERITY_OPTS_FEC)
+#define DM_VERITY_OPTS_MAX		(4 + DM_VERITY_OPTS_FEC)
 
 static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
@@ -506,60 +507,236 @@ static inline void verity_bv_skip_block(struct dm_verity *v,
 	bio_advance_iter(bio, iter, 1 << v->data_dev_block_bits);
 }
 
+/*
+ * The hash block of the lowest tree level that covers the data blocks
+ * being verified.  It is held while consecutive data blocks are verified,
+ * so that it (and the path to the root) is looked up once per run of data
+ * blocks rather than once per data block.
+ */
+struct verity_hash_cursor {
+	struct dm_buffer *buf;
+	sector_t hash_block;
+	u8 *data;
+};
+
+static void verity_cursor_release(struct verity_hash_cursor *cursor)
+{
+	if (cursor->buf) {
+		dm_bufio_release(cursor->buf);
+		cursor->buf = NULL;
+	}
+}
+
+/*
+ * Find a hash for a given block through the cursor and write it to digest.
+ *
+ * If "nowait" is false, the hash tree is verified as needed, like
+ * verity_hash_for_block does.  If "nowait" is true, nothing may sleep: only
+ * a hash block that is in the dm-bufio cache and has already been verified
+ * is used, and -EAGAIN is returned otherwise.
+ */
+static int verity_hash_for_block_cursor(struct dm_verity *v,
+					struct dm_verity_io *io,
+					struct verity_hash_cursor *cursor,
+					sector_t block, u8 *digest,
+					bool *is_zero, bool nowait)
+{
+	struct dm_buffer *buf;
+	struct buffer_aux *aux;
+	sector_t hash_block;
+	unsigned offset;
+	u8 *data;
+	int r;
+
+	if (unlikely(!v->levels)) {
+		memcpy(digest, v->root_digest, v->digest_size);
+		goto out;
+	}
+
+	verity_hash_at_level(v, block, 0, &hash_block, &offset);
+
+	if (cursor->buf && cursor->hash_block == hash_block) {
+		memcpy(digest, cursor->data + offset, v->digest_size);
+		goto out;
+	}
+
+	verity_cursor_release(cursor);
+
+	if (nowait) {
+		data = dm_bufio_get(v->bufio, hash_block, &buf);
+		if (IS_ERR_OR_NULL(data))
+			return -EAGAIN;
+	} else {
+		/* This verifies the hash block and its path to the root */
+		r = verity_hash_for_block(v, io, block, digest, is_zero);
+		if (unlikely(r))
+			return r;
+
+		data = dm_bufio_read(v->bufio, hash_block, &buf);
+		if (IS_ERR(data))
+			return 0;
+	}
+
+	aux = dm_bufio_get_aux_data(buf);
+	if (unlikely(!aux->hash_verified)) {
+		/*
+		 * Only a verified hash block is held.  An unverified one
+		 * (corrupted, in logging mode) is looked up and reported
+		 * again for every data block, as before.
+		 */
+		dm_bufio_release(buf);
+		return nowait ? -EAGAIN : 0;
+	}
+
+	cursor->buf = buf;
+	cursor->hash_block = hash_block;
+	cursor->data = data;
+
+	if (!nowait)
+		return 0;
+
+	memcpy(digest, data + offset, v->digest_size);
+out:
+	*is_zero = v->zero_digest &&
+		   !memcmp(v->zero_digest, digest, v->digest_size);
+
+	return 0;
+}
+
+/*
+ * Hash one data block with the asynchronous hash.
+ */
+static int verity_ahash_block(struct dm_verity *v, struct dm_verity_io *io,
+			      struct bvec_iter *iter, u8 *digest)
+{
+	struct ahash_request *req = verity_io_hash_req(v, io);
+	struct verity_result res;
+	int r;
+
+	r = verity_hash_init(v, req, &res);
+	if (unlikely(r < 0))
+		return r;
+
+	r = verity_for_io_block(v, io, iter, &res);
+	if (unlikely(r < 0))
+		return r;
+
+	return verity_hash_final(v, req, digest, &res);
+}
+
+/*
+ * Hash one data block with the synchronous hash, starting from the
+ * precomputed salted state if there is one.
+ */
+static int verity_shash_block(struct dm_verity *v, struct dm_verity_io *io,
+			      struct bvec_iter *iter, u8 *digest)
+{
+	SHASH_DESC_ON_STACK(desc, v->shash_tfm);
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
+	unsigned todo = 1 << v->data_dev_block_bits;
+	int r;
+
+	desc->tfm = v->shash_tfm;
+	desc->flags = 0;
+
+	if (likely(v->initial_hashstate)) {
+		r = crypto_shash_import(desc, v->initial_hashstate);
+	} else {
+		r = crypto_shash_init(desc);
+		if (!r && v->salt_size && v->version >= 1)
+			r = crypto_shash_update(desc, v->salt, v->salt_size);
+	}
+	if (unlikely(r < 0))
+		return r;
+
+	do {
+		u8 *page;
+		unsigned len;
+		struct bio_vec bv = bio_iter_iovec(bio, *iter);
+
+		page = kmap_atomic(bv.bv_page);
+		len = bv.bv_len;
+
+		if (likely(len >= todo))
+			len = todo;
+
+		r = crypto_shash_update(desc, page + bv.bv_offset, len);
+		kunmap_atomic(page);
+
+		if (unlikely(r < 0))
+			return r;
+
+		bio_advance_iter(bio, iter, len);
+		todo -= len;
+	} while (todo);
+
+	if (unlikely(v->salt_size && (!v->version)))
+		return crypto_shash_finup(desc, v->salt, v->salt_size, digest);
+
+	return crypto_shash_final(desc, digest);
+}
+
 /*
  * Verify one "dm_verity_io" structure.
+ *
+ * All the data blocks of the io are verified in one pass.  The lowest-level
+ * hash block is looked up through a cursor, once per run of data blocks it
+ * covers, and with a synchronous hash the blocks are hashed back to back
+ * without setting up a crypto request for each of them.
+ *
+ * If "nowait" is true, this runs in bio completion context and must not
+ * sleep.  Anything but the common case (a hash block that is not cached or
+ * not verified yet, or a digest mismatch that may need FEC or error
+ * handling) makes it return nonzero, and the io is then verified again
+ * from verify_wq.  io->iter is left untouched for that.
  */
-static int verity_verify_io(struct dm_verity_io *io)
+static int verity_verify_io(struct dm_verity_io *io, bool nowait)
 {
 	bool is_zero;
 	struct dm_verity *v = io->v;
+	struct verity_hash_cursor cursor = { NULL };
+	struct bvec_iter iter = io->iter;
 	struct bvec_iter start;
 	unsigned b;
-	struct verity_result res;
+	int r = 0;
 
 	for (b = 0; b < io->n_blocks; b++) {
-		int r;
 		sector_t cur_block = io->block + b;
-		struct ahash_request *req = verity_io_hash_req(v, io);
 
 		if (v->validated_blocks &&
 		    likely(test_bit(cur_block, v->validated_blocks))) {
-			verity_bv_skip_block(v, io, &io->iter);
+			verity_bv_skip_block(v, io, &iter);
 			continue;
 		}
 
-		r = verity_hash_for_block(v, io, cur_block,
-					  verity_io_want_digest(v, io),
-					  &is_zero);
-		if (unlikely(r < 0))
-			return r;
+		r = verity_hash_for_block_cursor(v, io, &cursor, cur_block,
+						 verity_io_want_digest(v, io),
+						 &is_zero, nowait);
+		if (unlikely(r))
+			break;
 
 		if (is_zero) {
 			/*
 			 * If we expect a zero block, don't validate, just
 			 * return zeros.
 			 */
-			r = verity_for_bv_block(v, io, &io->iter,
+			r = verity_for_bv_block(v, io, &iter,
 						verity_bv_zero);
 			if (unlikely(r < 0))
-				return r;
+				break;
 
 			continue;
 		}
 
-		r = verity_hash_init(v, req, &res);
-		if (unlikely(r < 0))
-			return r;
-
-		start = io->iter;
-		r = verity_for_io_block(v, io, &io->iter, &res);
-		if (unlikely(r < 0))
-			return r;
-
-		r = verity_hash_final(v, req, verity_io_real_digest(v, io),
-					&res);
+		start = iter;
+		if (v->shash_tfm)
+			r = verity_shash_block(v, io, &iter,
+					       verity_io_real_digest(v, io));
+		else
+			r = verity_ahash_block(v, io, &iter,
+					       verity_io_real_digest(v, io));
 		if (unlikely(r < 0))
-			return r;
+			break;
 
 		if (likely(memcmp(verity_io_real_digest(v, io),
 				  verity_io_want_digest(v, io), v->digest_size) == 0)) {
@@ -567,15 +744,28 @@ static int verity_verify_io(struct dm_verity_io *io)
 				set_bit(cur_block, v->validated_blocks);
 			continue;
 		}
-		else if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
-					   cur_block, NULL, &start) == 0)
+
+		if (nowait) {
+			r = -EAGAIN;
+			break;
+		}
+
+		/* FEC looks up other hash blocks */
+		verity_cursor_release(&cursor);
+
+		if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
+				      cur_block, NULL, &start) == 0)
 			continue;
 		else if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA,
-					   cur_block))
-			return -EIO;
+					   cur_block)) {
+			r = -EIO;
+			break;
+		}
 	}
 
-	return 0;
+	verity_cursor_release(&cursor);
+
+	return r;
 }
 
 /*
@@ -607,7 +797,23 @@ static void verity_work(struct work_struct *w)
 {
 	struct dm_verity_io *io = container_of(w, struct dm_verity_io, work);
 
-	verity_finish_io(io, errno_to_blk_status(verity_verify_io(io)));
+	verity_finish_io(io, errno_to_blk_status(verity_verify_io(io, false)));
+}
+
+static void verity_tasklet(unsigned long data)
+{
+	struct dm_verity_io *io = (struct dm_verity_io *)data;
+	struct dm_verity *v = io->v;
+
+	if (likely(!verity_verify_io(io, true))) {
+		percpu_counter_inc(&v->tasklet_verified);
+		verity_finish_io(io, BLK_STS_OK);
+		return;
+	}
+
+	percpu_counter_inc(&v->tasklet_deferred);
+	INIT_WORK(&io->work, verity_work);
+	queue_work(v->verify_wq, &io->work);
 }
 
 static void verity_end_io(struct bio *bio)
@@ -622,6 +828,20 @@ static void verity_end_io(struct bio *bio)
 		return;
 	}
 
+	if (io->v->use_tasklet && !bio->bi_status) {
+		/*
+		 * Some drivers complete bios from hard interrupt context,
+		 * which is no place for hashing: bounce those to a tasklet.
+		 */
+		if (in_irq() || irqs_disabled()) {
+			tasklet_init(&io->tasklet, verity_tasklet,
+				     (unsigned long)io);
+			tasklet_schedule(&io->tasklet);
+		} else
+			verity_tasklet((unsigned long)io);
+		return;
+	}
+
 	INIT_WORK(&io->work, verity_work);
 	queue_work(io->v->verify_wq, &io->work);
 }
@@ -744,6 +964,10 @@ void verity_status(struct dm_target *ti, status_type_t type,
 	switch (type) {
 	case STATUSTYPE_INFO:
 		DMEMIT("%c", v->hash_failed ? 'C' : 'V');
+		if (v->use_tasklet)
+			DMEMIT(" %lld %lld",
+			       (long long)percpu_counter_sum(&v->tasklet_verified),
+			       (long long)percpu_counter_sum(&v->tasklet_deferred));
 		break;
 	case STATUSTYPE_TABLE:
 		DMEMIT("%u %s %s %u %u %llu %llu %s ",
@@ -772,6 +996,8 @@ void verity_status(struct dm_target *ti, status_type_t type,
 			args++;
 		if (v->validated_blocks)
 			args++;
+		if (v->use_tasklet)
+			args++;
 		if (!args)
 			return;
 		DMEMIT(" %u", args);
@@ -792,6 +1018,8 @@ void verity_status(struct dm_target *ti, status_type_t type,
 			DMEMIT(" " DM_VERITY_OPT_IGN_ZEROES);
 		if (v->validated_blocks)
 			DMEMIT(" " DM_VERITY_OPT_AT_MOST_ONCE);
+		if (v->use_tasklet)
+			DMEMIT(" " DM_VERITY_OPT_TASKLET_VERIFY);
 		sz = verity_fec_status_table(v, sz, result, maxlen);
 		break;
 	}
@@ -853,6 +1081,13 @@ void verity_dtr(struct dm_target *ti)
 	if (v->tfm)
 		crypto_free_ahash(v->tfm);
 
+	kfree(v->initial_hashstate);
+	if (v->shash_tfm)
+		crypto_free_shash(v->shash_tfm);
+
+	percpu_counter_destroy(&v->tasklet_verified);
+	percpu_counter_destroy(&v->tasklet_deferred);
+
 	kfree(v->alg_name);
 
 	if (v->hash_dev)
@@ -918,6 +1153,61 @@ static int verity_alloc_zero_digest(struct dm_verity *v)
 	return r;
 }
 
+/*
+ * Hash data blocks with the shash API when the ahash is a synchronous
+ * implementation anyway, which saves setting up a crypto request and
+ * waiting for its completion for every block.  Verification in completion
+ * context needs a synchronous hash in any case.
+ */
+static int verity_alloc_shash(struct dm_verity *v)
+{
+	struct dm_target *ti = v->ti;
+	struct crypto_shash *shash;
+	int r;
+
+	shash = crypto_alloc_shash(v->alg_name, 0, 0);
+	if (IS_ERR(shash)) {
+		if (!v->use_tasklet)
+			return 0;
+		ti->error = "Cannot initialize synchronous hash function";
+		return PTR_ERR(shash);
+	}
+
+	if (!v->use_tasklet &&
+	    strcmp(crypto_tfm_alg_driver_name(crypto_ahash_tfm(v->tfm)),
+		   crypto_tfm_alg_driver_name(crypto_shash_tfm(shash)))) {
+		crypto_free_shash(shash);
+		return 0;
+	}
+	v->shash_tfm = shash;
+
+	/* Hash the leading salt once; every data block starts from there */
+	if (v->salt_size && v->version >= 1) {
+		SHASH_DESC_ON_STACK(desc, shash);
+
+		v->initial_hashstate = kmalloc(crypto_shash_statesize(shash),
+					       GFP_KERNEL);
+		if (!v->initial_hashstate) {
+			ti->error = "Cannot allocate initial hash state";
+			return -ENOMEM;
+		}
+
+		desc->tfm = shash;
+		desc->flags = 0;
+		r = crypto_shash_init(desc);
+		if (!r)
+			r = crypto_shash_update(desc, v->salt, v->salt_size);
+		if (!r)
+			r = crypto_shash_export(desc, v->initial_hashstate);
+		if (r) {
+			ti->error = "Cannot compute initial hash state";
+			return r;
+		}
+	}
+
+	return 0;
+}
+
 static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v)
 {
 	int r;
@@ -962,6 +1252,10 @@ static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v)
 				return r;
 			continue;
 
+		} else if (!strcasecmp(arg_name, DM_VERITY_OPT_TASKLET_VERIFY)) {
+			v->use_tasklet = true;
+			continue;
+
 		} else if (verity_is_fec_opt_arg(arg_name)) {
 			r = verity_fec_parse_opt_args(as, v, &argc, arg_name);
 			if (r)
@@ -1163,6 +1457,21 @@ int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 			goto bad;
 	}
 
+	r = verity_alloc_shash(v);
+	if (r)
+		goto bad;
+
+	if (v->use_tasklet) {
+		r = percpu_counter_init(&v->tasklet_verified, 0, GFP_KERNEL);
+		if (!r)
+			r = percpu_counter_init(&v->tasklet_deferred, 0,
+						GFP_KERNEL);
+		if (r) {
+			ti->error = "Cannot allocate verification counters";
+			goto bad;
+		}
+	}
+
 #ifdef CONFIG_DM_ANDROID_VERITY_AT_MOST_ONCE_DEFAULT_ENABLED
 	if (!v->validated_blocks) {
 		r = verity_alloc_most_once(v);
@@ -1204,7 +1513,8 @@ int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 
 	v->bufio = dm_bufio_client_create(v->hash_dev->bdev,
 		1 << v->hash_dev_block_bits, 1, sizeof(struct buffer_aux),
-		dm_bufio_alloc_callback, NULL);
+		dm_bufio_alloc_callback, NULL,
+		v->use_tasklet ? DM_BUFIO_CLIENT_NO_SLEEP : 0);
 	if (IS_ERR(v->bufio)) {
 		ti->error = "Cannot initialize dm-bufio";
 		r = PTR_ERR(v->bufio);
@@ -1256,7 +1566,7 @@ EXPORT_SYMBOL_GPL(verity_ctr);
 static struct target_type verity_target = {
 	.name		= "verity",
 	.features	= DM_TARGET_IMMUTABLE,
-	.version	= {1, 4, 0},
+	.version	= {1, 5, 0},
 	.module		= THIS_MODULE,
 	.ctr		= verity_ctr,
 	.dtr		= verity_dtr,
@@ -14,6 +14,8 @@
 
 #include "dm-bufio.h"
 #include <linux/device-mapper.h>
+#include <linux/interrupt.h>
+#include <linux/percpu_counter.h>
 #include <crypto/hash.h>
 
 #define DM_VERITY_MAX_LEVELS		63
@@ -38,6 +40,8 @@ struct dm_verity {
 	struct dm_bufio_client *bufio;
 	char *alg_name;
 	struct crypto_ahash *tfm;
+	struct crypto_shash *shash_tfm;	/* synchronous hash, if usable */
+	u8 *initial_hashstate;	/* shash state after the leading salt */
 	u8 *root_digest;	/* digest of the root block */
 	u8 *salt;		/* salt: its size is salt_size */
 	u8 *zero_digest;	/* digest for a zero block */
@@ -56,6 +60,11 @@ struct dm_verity {
 	int hash_failed;	/* set to 1 if hash of any block failed */
 	enum verity_mode mode;	/* mode for handling verification errors */
 	unsigned corrupted_errs;/* Number of errors for corrupted blocks */
+	bool use_tasklet;	/* try to verify in bio completion context */
+
+	/* ios verified in completion context / deferred to verify_wq */
+	struct percpu_counter tasklet_verified;
+	struct percpu_counter tasklet_deferred;
 
 	struct workqueue_struct *verify_wq;
 
@@ -78,6 +87,7 @@ struct dm_verity_io {
 	unsigned n_blocks;
 
 	struct work_struct work;
+	struct tasklet_struct tasklet;
 
 	/*
 	 * Three variably-size fields follow this struct:
@@ -2808,7 +2808,8 @@ struct dm_md_mempools *dm_alloc_md_mempools(struct mapped_device *md, enum dm_qu
 		BUG();
 	}
 
-	pools->bs = bioset_create(pool_size, front_pad, BIOSET_NEED_RESCUER);
+	pools->bs = bioset_create(pool_size, front_pad,
+				  BIOSET_NEED_RESCUER | BIOSET_PERCPU_CACHE);
 	if (!pools->bs)
 		goto out;
 
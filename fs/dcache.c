@@ -132,6 +132,15 @@ struct dentry_stat_t dentry_stat = {
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
+static DEFINE_PER_CPU(long, nr_dentry_negative);
+
+/*
+ * Unused negative dentries a superblock may keep, in percent of all its
+ * dentries; 0 means no limit.  Superblocks with fewer than
+ * NEGATIVE_DENTRY_MIN of them are never trimmed.
+ */
+int sysctl_negative_dentry_limit __read_mostly;
+#define NEGATIVE_DENTRY_MIN	1024
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
@@ -165,11 +174,21 @@ static long get_nr_dentry_unused(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static long get_nr_dentry_negative(void)
+{
+	int i;
+	long sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative, i);
+	return sum < 0 ? 0 : sum;
+}
+
 int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative = get_nr_dentry_negative();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -324,12 +343,49 @@ void release_dentry_name_snapshot(struct name_snapshot *name)
 }
 EXPORT_SYMBOL(release_dentry_name_snapshot);
 
+/*
+ * Unused negative dentries, i.e. negative dentries with DCACHE_LRU_LIST
+ * set, are counted globally for dentry-state and per superblock for the
+ * negative dentry budget.  d_lock must be held by the caller.
+ */
+static void dentry_negative_add(struct dentry *dentry, long nr)
+{
+	this_cpu_add(nr_dentry_negative, nr);
+	percpu_counter_add(&dentry->d_sb->s_nr_dentry_negative, nr);
+}
+
+static s64 d_negative_limit(struct super_block *sb)
+{
+	int limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	if (!limit)
+		return S64_MAX;
+	return max_t(s64, NEGATIVE_DENTRY_MIN,
+		     div_s64(percpu_counter_read_positive(&sb->s_nr_dentry) *
+			     limit, 100));
+}
+
+/*
+ * A negative dentry was added to the LRU: if that takes the superblock
+ * over its budget, kick off the trimming.
+ */
+static void d_negative_check_limit(struct super_block *sb)
+{
+	if (percpu_counter_read_positive(&sb->s_nr_dentry_negative) <=
+	    d_negative_limit(sb))
+		return;
+	if (!work_pending(&sb->s_dentry_trim_work))
+		queue_work(system_unbound_wq, &sb->s_dentry_trim_work);
+}
+
 static inline void __d_set_inode_and_type(struct dentry *dentry,
 					  struct inode *inode,
 					  unsigned type_flags)
 {
 	unsigned flags;
 
+	if ((dentry->d_flags & DCACHE_LRU_LIST) && d_is_negative(dentry))
+		dentry_negative_add(dentry, -1);
 	dentry->d_inode = inode;
 	flags = READ_ONCE(dentry->d_flags);
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
@@ -344,6 +400,8 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
+	if (flags & DCACHE_LRU_LIST)
+		dentry_negative_add(dentry, 1);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -396,7 +454,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * on the shrink list (ie not on the superblock LRU list).
  *
  * The per-cpu "nr_dentry_unused" counters are updated with
- * the DCACHE_LRU_LIST bit.
+ * the DCACHE_LRU_LIST bit, and so are the negative dentry
+ * counters for negative dentries.
  *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
@@ -407,6 +466,10 @@ static void d_lru_add(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry)) {
+		dentry_negative_add(dentry, 1);
+		d_negative_check_limit(dentry->d_sb);
+	}
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -415,6 +478,8 @@ static void d_lru_del(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		dentry_negative_add(dentry, -1);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -424,6 +489,8 @@ static void d_shrink_del(struct dentry *dentry)
 	list_del_init(&dentry->d_lru);
 	dentry->d_flags &= ~(DCACHE_SHRINK_LIST | DCACHE_LRU_LIST);
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		dentry_negative_add(dentry, -1);
 }
 
 static void d_shrink_add(struct dentry *dentry, struct list_head *list)
@@ -432,6 +499,8 @@ static void d_shrink_add(struct dentry *dentry, struct list_head *list)
 	list_add(&dentry->d_lru, list);
 	dentry->d_flags |= DCACHE_SHRINK_LIST | DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		dentry_negative_add(dentry, 1);
 }
 
 /*
@@ -445,6 +514,8 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		dentry_negative_add(dentry, -1);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -592,6 +663,7 @@ static void __dentry_kill(struct dentry *dentry)
 	else
 		spin_unlock(&dentry->d_lock);
 	this_cpu_dec(nr_dentry);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry);
 	if (dentry->d_op && dentry->d_op->d_release)
 		dentry->d_op->d_release(dentry);
 
@@ -1154,6 +1226,82 @@ long prune_dcache_sb(struct super_block *sb, struct shrink_control *sc)
 	return freed;
 }
 
+static enum lru_status dentry_negative_lru_isolate(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	/*
+	 * Positive dentries we walk past are rotated so that every batch does
+	 * not start at the same ones.  Their DCACHE_REFERENCED is left alone:
+	 * it is for the memory pressure shrinker to consume, not us.
+	 */
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	/* Referenced negative dentries get another pass, as in the shrinker */
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, freeable);
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+/**
+ * d_negative_trim_work - enforce the negative dentry budget of a superblock
+ * @work: the superblock's s_dentry_trim_work
+ *
+ * Queued when adding a negative dentry to the LRU takes the superblock over
+ * sysctl_negative_dentry_limit.  Walks the LRU once at most, freeing unused
+ * negative dentries until they are back under 7/8 of the limit, so that it
+ * is not requeued right away.
+ */
+void d_negative_trim_work(struct work_struct *work)
+{
+	struct super_block *sb = container_of(work, struct super_block,
+					      s_dentry_trim_work);
+	unsigned long nr_to_walk;
+	s64 target;
+
+	if (!trylock_super(sb))
+		return;
+
+	target = d_negative_limit(sb);
+	target -= target >> 3;
+	nr_to_walk = list_lru_count(&sb->s_dentry_lru);
+
+	while (nr_to_walk &&
+	       percpu_counter_sum_positive(&sb->s_nr_dentry_negative) > target) {
+		unsigned long nr = min(nr_to_walk, 1024UL);
+		LIST_HEAD(dispose);
+
+		nr_to_walk -= nr;
+		list_lru_walk(&sb->s_dentry_lru, dentry_negative_lru_isolate,
+			      &dispose, nr);
+		shrink_dentry_list(&dispose);
+		cond_resched();
+	}
+
+	up_read(&sb->s_umount);
+}
+
 static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
 {
@@ -1693,6 +1841,7 @@ struct dentry *__d_alloc(struct super_block *sb, const struct qstr *name)
 	}
 
 	this_cpu_inc(nr_dentry);
+	percpu_counter_inc(&sb->s_nr_dentry);
 
 	return dentry;
 }
@@ -1547,6 +1547,8 @@ static long writeback_chunk_size(struct bdi_writeback *wb,
 		pages = min(wb->avg_write_bandwidth / 2,
 			    global_wb_domain.dirty_limit / DIRTY_SCOPE);
 		pages = min(pages, work->nr_pages);
+		/* smaller chunks while reads miss their latency target */
+		pages >>= bdi_dirty_lat_step(wb->bdi);
 		pages = round_down(pages + MIN_WRITEBACK_PAGES,
 				   MIN_WRITEBACK_PAGES);
 	}
@@ -306,7 +306,4 @@ extern const struct file_operations proc_clear_refs_operations;
 extern const struct file_operations proc_pagemap_operations;
 
 extern unsigned long task_vsize(struct mm_struct *);
-extern unsigned long task_statm(struct mm_struct *,
-				unsigned long *, unsigned long *,
-				unsigned long *, unsigned long *);
 extern void task_mem(struct seq_file *, struct mm_struct *);
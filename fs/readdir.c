@@ -14,12 +14,16 @@
 #include <linux/stat.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/namei.h>
+#include <linux/mount.h>
 #include <linux/fsnotify.h>
 #include <linux/dirent.h>
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
 #include <linux/compat.h>
+#include <linux/slab.h>
+#include <linux/cred.h>
 
 #include <linux/uaccess.h>
 
@@ -370,6 +374,239 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 	return error;
 }
 
+/*
+ * getdents64_statx() reads the directory into a kernel buffer first and
+ * only looks the names up once iterate_dir() has dropped the directory
+ * lock, so the attributes come from the dcache/icache whenever the entry
+ * is cached and the filesystem is only asked for the ones that are not.
+ */
+#define GETDENTS_STATX_MAX_BUF	(64 * 1024)
+
+struct getdents_statx_callback {
+	struct dir_context ctx;
+	void *buf;
+	struct linux_dirent64_statx *previous;
+	unsigned int used;
+	unsigned int size;
+	unsigned int types;
+	int error;
+};
+
+static int filldir64_statx(struct dir_context *ctx, const char *name,
+			   int namlen, loff_t offset, u64 ino,
+			   unsigned int d_type)
+{
+	struct linux_dirent64_statx *dirent;
+	struct getdents_statx_callback *buf =
+		container_of(ctx, struct getdents_statx_callback, ctx);
+	int reclen = ALIGN(offsetof(struct linux_dirent64_statx, d_name) +
+			   namlen + 1, sizeof(u64));
+
+	buf->error = verify_dirent_name(name, namlen);
+	if (unlikely(buf->error))
+		return buf->error;
+	if (buf->previous) {
+		if (signal_pending(current))
+			return -EINTR;
+		buf->previous->d_off = offset;
+	}
+
+	/* Entries of unknown type are filtered once they have been stat'ed */
+	if (buf->types && d_type != DT_UNKNOWN && !(buf->types & (1U << d_type)))
+		return 0;
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->size - buf->used)
+		return -EINVAL;
+
+	dirent = buf->buf + buf->used;
+	memset(dirent, 0, offsetof(struct linux_dirent64_statx, d_name));
+	dirent->d_ino = ino;
+	dirent->d_reclen = reclen;
+	dirent->d_type = d_type;
+	memcpy(dirent->d_name, name, namlen);
+	dirent->d_name[namlen] = 0;
+	buf->previous = dirent;
+	buf->used += reclen;
+	return 0;
+}
+
+static struct dentry *getdents_statx_lookup(struct path *dir,
+					    struct linux_dirent64_statx *dirent)
+{
+	const char *name = dirent->d_name;
+	int len = strlen(name);
+
+	if (len == 1 && name[0] == '.')
+		return dget(dir->dentry);
+	if (len == 2 && name[0] == '.' && name[1] == '.') {
+		/* Leave ".." of a mount root to the caller */
+		if (dir->dentry == dir->mnt->mnt_root)
+			return ERR_PTR(-EXDEV);
+		return dget_parent(dir->dentry);
+	}
+	return lookup_one_len_unlocked(name, dir->dentry, len);
+}
+
+static void getdents_statx_fill(struct path *dir,
+				struct linux_dirent64_statx *dirent,
+				u32 mask, unsigned int flags)
+{
+	struct path path = { .mnt = dir->mnt };
+	struct kstat stat;
+
+	path.dentry = getdents_statx_lookup(dir, dirent);
+	if (IS_ERR(path.dentry))
+		return;
+	if (d_really_is_negative(path.dentry) ||
+	    vfs_getattr(&path, &stat, mask, flags)) {
+		dput(path.dentry);
+		return;
+	}
+	dput(path.dentry);
+
+	dirent->d_mask = stat.result_mask;
+	if (dirent->d_type == DT_UNKNOWN)
+		dirent->d_type = (stat.mode & S_IFMT) >> 12;
+	dirent->d_nlink = stat.nlink;
+	dirent->d_uid = from_kuid_munged(current_user_ns(), stat.uid);
+	dirent->d_gid = from_kgid_munged(current_user_ns(), stat.gid);
+	dirent->d_mode = stat.mode;
+	dirent->d_size = stat.size;
+	dirent->d_blocks = stat.blocks;
+	dirent->d_atime.tv_sec = stat.atime.tv_sec;
+	dirent->d_atime.tv_nsec = stat.atime.tv_nsec;
+	dirent->d_btime.tv_sec = stat.btime.tv_sec;
+	dirent->d_btime.tv_nsec = stat.btime.tv_nsec;
+	dirent->d_ctime.tv_sec = stat.ctime.tv_sec;
+	dirent->d_ctime.tv_nsec = stat.ctime.tv_nsec;
+	dirent->d_mtime.tv_sec = stat.mtime.tv_sec;
+	dirent->d_mtime.tv_nsec = stat.mtime.tv_nsec;
+	dirent->d_rdev_major = MAJOR(stat.rdev);
+	dirent->d_rdev_minor = MINOR(stat.rdev);
+	dirent->d_dev_major = MAJOR(stat.dev);
+	dirent->d_dev_minor = MINOR(stat.dev);
+}
+
+/*
+ * Fill in the attributes of every buffered entry and drop the ones whose
+ * type only turned out not to match the filter now.  Returns the number of
+ * bytes left in the buffer.
+ */
+static unsigned int getdents_statx_fill_all(struct file *file,
+					    struct getdents_statx_callback *buf,
+					    u32 mask, unsigned int flags)
+{
+	struct linux_dirent64_statx *dirent, *last = NULL;
+	bool may_lookup = mask || buf->types;
+	unsigned int pos, out = 0;
+
+	/* Same search permission fstatat() would need on the directory */
+	if (may_lookup && inode_permission(file_inode(file), MAY_EXEC))
+		may_lookup = false;
+
+	for (pos = 0; pos < buf->used; pos += dirent->d_reclen) {
+		dirent = buf->buf + pos;
+
+		if (may_lookup && (mask || dirent->d_type == DT_UNKNOWN))
+			getdents_statx_fill(&file->f_path, dirent, mask, flags);
+
+		if (buf->types && !(buf->types & (1U << dirent->d_type))) {
+			if (last)
+				last->d_off = dirent->d_off;
+			continue;
+		}
+
+		last = buf->buf + out;
+		if (out != pos)
+			memmove(last, dirent, dirent->d_reclen);
+		out += last->d_reclen;
+		cond_resched();
+	}
+	return out;
+}
+
+/**
+ * sys_getdents64_statx - Read directory entries along with their attributes
+ * @fd: Directory to read.
+ * @dirent: Buffer that receives struct linux_dirent64_statx records.
+ * @count: Size of @dirent.
+ * @flags: AT_STATX_* sync flags, as for statx().
+ * @mask: STATX_* attributes wanted for each entry.
+ * @types: If non-zero, only return entries whose DT_* type has its bit
+ *	   (1 << DT_*) set.
+ *
+ * Works like getdents64() followed by fstatat(fd, name, AT_SYMLINK_NOFOLLOW)
+ * on each entry, in one call.  Symlinks and automount points are not
+ * followed.  Returns the number of bytes written, 0 at end of directory.
+ */
+SYSCALL_DEFINE6(getdents64_statx, unsigned int, fd,
+		struct linux_dirent64_statx __user *, dirent,
+		unsigned int, count, unsigned int, flags,
+		unsigned int, mask, unsigned int, types)
+{
+	struct fd f;
+	struct getdents_statx_callback buf = {
+		.ctx.actor = filldir64_statx,
+		.types = types,
+	};
+	unsigned int used;
+	int error;
+
+	if (flags & ~AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if ((flags & AT_STATX_SYNC_TYPE) == AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if (mask & STATX__RESERVED)
+		return -EINVAL;
+	if (types >= (1U << (DT_WHT + 1)))
+		return -EINVAL;
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		return -EFAULT;
+
+	buf.size = min_t(unsigned int, count, GETDENTS_STATX_MAX_BUF);
+	buf.buf = kvmalloc(buf.size, GFP_KERNEL);
+	if (!buf.buf)
+		return -ENOMEM;
+
+	f = fdget_pos(fd);
+	if (!f.file) {
+		error = -EBADF;
+		goto out_free;
+	}
+
+	do {
+		buf.used = 0;
+		buf.previous = NULL;
+		buf.error = 0;
+
+		error = iterate_dir(f.file, &buf.ctx);
+		if (error >= 0)
+			error = buf.error;
+		if (!buf.previous)
+			break;
+		buf.previous->d_off = buf.ctx.pos;
+
+		/*
+		 * Everything read so far may get filtered out once the
+		 * DT_UNKNOWN entries have been stat'ed; keep going rather
+		 * than returning 0, which would look like end of directory.
+		 */
+		used = getdents_statx_fill_all(f.file, &buf, mask, flags);
+		if (used) {
+			error = copy_to_user(dirent, buf.buf, used) ?
+				-EFAULT : used;
+			break;
+		}
+		error = 0;
+	} while (!fatal_signal_pending(current));
+
+	fdput_pos(f);
+out_free:
+	kvfree(buf.buf);
+	return error;
+}
+
 #ifdef CONFIG_COMPAT
 struct compat_old_linux_dirent {
 	compat_ulong_t	d_ino;
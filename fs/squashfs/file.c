@@ -47,6 +47,7 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -507,7 +508,204 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	return 0;
 }
 
+/*
+ * Readahead.  The pages of the readahead window are grouped by datablock,
+ * and each datablock is read and decompressed by a work item on an unbound
+ * workqueue, so the blocks of a window are decompressed in parallel (with
+ * the percpu decompressor each CPU uses its own stream).  The pages stay
+ * locked until their block has been decompressed, which is what readers
+ * wait on.  The last block of the window is read by the caller itself.
+ */
+static struct workqueue_struct *squashfs_read_wq;
+
+struct squashfs_readahead_block {
+	struct work_struct	work;
+	struct inode		*inode;
+	int			index;		/* datablock index */
+	pgoff_t			start_index;	/* first page of the block */
+	int			pages;
+	struct page		*page[];
+};
+
+static struct squashfs_readahead_block *squashfs_readahead_alloc(
+	struct inode *inode, int index)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	pgoff_t file_end = (i_size_read(inode) - 1) >> PAGE_SHIFT;
+	pgoff_t start_index = (pgoff_t)index << shift;
+	pgoff_t end_index = start_index + (1 << shift) - 1;
+	struct squashfs_readahead_block *rab;
+
+	if (end_index > file_end)
+		end_index = file_end;
+
+	rab = kzalloc(sizeof(*rab) + (end_index - start_index + 1) *
+			sizeof(struct page *), GFP_KERNEL);
+	if (rab == NULL)
+		return NULL;
+
+	rab->inode = inode;
+	rab->index = index;
+	rab->start_index = start_index;
+	rab->pages = end_index - start_index + 1;
+	return rab;
+}
+
+static void squashfs_readahead_read(struct squashfs_readahead_block *rab)
+{
+	struct inode *inode = rab->inode;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	int expected = rab->index == file_end ?
+			(i_size_read(inode) & (msblk->block_size - 1)) :
+			 msblk->block_size;
+	u64 block = 0;
+	int bsize, i;
+
+	/*
+	 * Pick up the pages of the block that were not part of the readahead
+	 * window, so the block can be decompressed straight into the page
+	 * cache.  Pages that are already uptodate are left alone.
+	 */
+	for (i = 0; i < rab->pages; i++) {
+		if (rab->page[i])
+			continue;
+		rab->page[i] = grab_cache_page_nowait(inode->i_mapping,
+						      rab->start_index + i);
+		if (rab->page[i] && PageUptodate(rab->page[i])) {
+			unlock_page(rab->page[i]);
+			put_page(rab->page[i]);
+			rab->page[i] = NULL;
+		}
+	}
+
+	bsize = read_blocklist(inode, rab->index, &block);
+	if (bsize > 0) {
+		/* This unlocks and releases all the pages */
+		squashfs_readpages_block(inode, block, bsize, expected,
+					 rab->page, rab->pages);
+		return;
+	}
+
+	for (i = 0; i < rab->pages; i++) {
+		struct page *page = rab->page[i];
+
+		if (page == NULL)
+			continue;
+		if (bsize == 0) {
+			/* Sparse block */
+			zero_user(page, 0, PAGE_SIZE);
+			SetPageUptodate(page);
+		} else
+			SetPageError(page);
+		unlock_page(page);
+		put_page(page);
+	}
+}
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead_block *rab =
+		container_of(work, struct squashfs_readahead_block, work);
+
+	squashfs_readahead_read(rab);
+	kfree(rab);
+}
+
+static void squashfs_readahead_submit(struct squashfs_readahead_block *rab,
+	bool last)
+{
+	if (last) {
+		squashfs_readahead_read(rab);
+		kfree(rab);
+		return;
+	}
+
+	INIT_WORK(&rab->work, squashfs_readahead_work);
+	queue_work(squashfs_read_wq, &rab->work);
+}
+
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	pgoff_t last_page = (i_size_read(inode) + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	struct squashfs_readahead_block *rab = NULL;
+
+	TRACE("Entered squashfs_readpages, %u pages, start block %llx\n",
+				nr_pages, squashfs_i(inode)->start);
+
+	while (!list_empty(pages)) {
+		struct page *page = lru_to_page(pages);
+		int index = page->index >> shift;
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					  readahead_gfp_mask(mapping))) {
+			put_page(page);
+			continue;
+		}
+
+		if (rab && rab->index != index) {
+			squashfs_readahead_submit(rab, false);
+			rab = NULL;
+		}
+
+		/*
+		 * The tail-end fragment is shared with other files and goes
+		 * through the fragment cache, one page at a time.
+		 */
+		if (page->index >= last_page || (index == file_end &&
+		    squashfs_i(inode)->fragment_block != SQUASHFS_INVALID_BLK))
+			goto read_one;
+
+		if (rab == NULL) {
+			rab = squashfs_readahead_alloc(inode, index);
+			if (rab == NULL)
+				goto read_one;
+		}
+		rab->page[page->index - rab->start_index] = page;
+		continue;
+
+read_one:
+		squashfs_readpage(file, page);
+		put_page(page);
+	}
+
+	if (rab)
+		squashfs_readahead_submit(rab, true);
+
+	return 0;
+}
+
+int __init squashfs_init_read_wq(void)
+{
+	squashfs_read_wq = alloc_workqueue("squashfs_read",
+					   WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	return squashfs_read_wq ? 0 : -ENOMEM;
+}
+
+void squashfs_destroy_read_wq(void)
+{
+	destroy_workqueue(squashfs_read_wq);
+}
+
+/*
+ * Readahead workers drop their cache entry after unlocking the last page
+ * of their block, so evicting the inodes does not wait for them.  The
+ * caches must not be freed until they are done.
+ */
+void squashfs_flush_read_wq(void)
+{
+	flush_workqueue(squashfs_read_wq);
+}
+
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
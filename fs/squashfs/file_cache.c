@@ -36,3 +36,39 @@ int squashfs_readpage_block(struct page *page, u64 block, int bsize, int expecte
 	squashfs_cache_put(buffer);
 	return res;
 }
+
+/*
+ * Read a datablock for readahead.  @page holds the locked pages of the
+ * block, with NULL for the ones that could not be grabbed.  All the pages
+ * are unlocked and released on return.
+ */
+int squashfs_readpages_block(struct inode *inode, u64 block, int bsize,
+	int expected, struct page **page, int pages)
+{
+	struct squashfs_cache_entry *buffer = squashfs_get_datablock(
+		inode->i_sb, block, bsize);
+	int res = buffer->error, i, offset = 0;
+
+	if (res)
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+
+	for (i = 0; i < pages; i++, offset += PAGE_SIZE) {
+		if (page[i] == NULL)
+			continue;
+
+		if (res) {
+			SetPageError(page[i]);
+		} else {
+			int avail = clamp_t(int, expected - offset, 0,
+					    PAGE_SIZE);
+
+			squashfs_fill_page(page[i], buffer, offset, avail);
+		}
+		unlock_page(page[i]);
+		put_page(page[i]);
+	}
+
+	squashfs_cache_put(buffer);
+	return res;
+}
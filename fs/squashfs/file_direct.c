@@ -20,8 +20,46 @@
 #include "squashfs.h"
 #include "page_actor.h"
 
-static int squashfs_read_cache(struct page *target_page, u64 block, int bsize,
-	int pages, struct page **page, int bytes);
+static int squashfs_read_cache(struct inode *i, struct page *target_page,
+	u64 block, int bsize, int pages, struct page **page, int bytes);
+
+/*
+ * Decompress a datablock straight into @page, which must hold every page
+ * covered by the block
+ */
+static int squashfs_read_direct(struct inode *inode, u64 block, int bsize,
+	int expected, struct page **page, int pages)
+{
+	struct squashfs_page_actor *actor;
+	void *pageaddr;
+	int res, bytes;
+
+	/*
+	 * Create a "page actor" which will kmap and kunmap the
+	 * page cache pages appropriately within the decompressor
+	 */
+	actor = squashfs_page_actor_init_special(page, pages, 0);
+	if (actor == NULL)
+		return -ENOMEM;
+
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+	kfree(actor);
+	if (res < 0)
+		return res;
+
+	if (res != expected)
+		return -EIO;
+
+	/* Last page may have trailing bytes not filled */
+	bytes = res % PAGE_SIZE;
+	if (bytes) {
+		pageaddr = kmap_atomic(page[pages - 1]);
+		memset(pageaddr + bytes, 0, PAGE_SIZE - bytes);
+		kunmap_atomic(pageaddr);
+	}
+
+	return 0;
+}
 
 /* Read separately compressed datablock directly into page cache */
 int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
@@ -35,10 +73,8 @@ int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
 	int mask = (1 << (msblk->block_log - PAGE_SHIFT)) - 1;
 	int start_index = target_page->index & ~mask;
 	int end_index = start_index | mask;
-	int i, n, pages, missing_pages, bytes, res = -ENOMEM;
+	int i, n, pages, missing_pages, res = -ENOMEM;
 	struct page **page;
-	struct squashfs_page_actor *actor;
-	void *pageaddr;
 
 	if (end_index > file_end)
 		end_index = file_end;
@@ -49,14 +85,6 @@ int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
 	if (page == NULL)
 		return res;
 
-	/*
-	 * Create a "page actor" which will kmap and kunmap the
-	 * page cache pages appropriately within the decompressor
-	 */
-	actor = squashfs_page_actor_init_special(page, pages, 0);
-	if (actor == NULL)
-		goto out;
-
 	/* Try to grab all the pages covered by the Squashfs block */
 	for (missing_pages = 0, i = 0, n = start_index; i < pages; i++, n++) {
 		page[i] = (n == target_page->index) ? target_page :
@@ -83,8 +111,8 @@ int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
 		 * squashfs_readpage also trying to grab them.  Fall back to
 		 * using an intermediate buffer.
 		 */
-		res = squashfs_read_cache(target_page, block, bsize, pages,
-							page, expected);
+		res = squashfs_read_cache(inode, target_page, block, bsize,
+							pages, page, expected);
 		if (res < 0)
 			goto mark_errored;
 
@@ -92,23 +120,10 @@ int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
 	}
 
 	/* Decompress directly into the page cache buffers */
-	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+	res = squashfs_read_direct(inode, block, bsize, expected, page, pages);
 	if (res < 0)
 		goto mark_errored;
 
-	if (res != expected) {
-		res = -EIO;
-		goto mark_errored;
-	}
-
-	/* Last page may have trailing bytes not filled */
-	bytes = res % PAGE_SIZE;
-	if (bytes) {
-		pageaddr = kmap_atomic(page[pages - 1]);
-		memset(pageaddr + bytes, 0, PAGE_SIZE - bytes);
-		kunmap_atomic(pageaddr);
-	}
-
 	/* Mark pages as uptodate, unlock and release */
 	for (i = 0; i < pages; i++) {
 		flush_dcache_page(page[i]);
@@ -118,7 +133,6 @@ int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
 			put_page(page[i]);
 	}
 
-	kfree(actor);
 	kfree(page);
 
 	return 0;
@@ -137,16 +151,53 @@ int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
 	}
 
 out:
-	kfree(actor);
 	kfree(page);
 	return res;
 }
 
+/*
+ * Read a datablock for readahead.  @page holds the locked pages of the
+ * block, with NULL for the ones that could not be grabbed.  All the pages
+ * are unlocked and released on return.
+ */
+int squashfs_readpages_block(struct inode *inode, u64 block, int bsize,
+	int expected, struct page **page, int pages)
+{
+	int i, res, missing_pages = 0;
+
+	for (i = 0; i < pages; i++)
+		if (page[i] == NULL)
+			missing_pages++;
+
+	if (missing_pages) {
+		res = squashfs_read_cache(inode, NULL, block, bsize, pages,
+							page, expected);
+		if (res == 0)
+			return 0;
+	} else {
+		res = squashfs_read_direct(inode, block, bsize, expected,
+							page, pages);
+	}
+
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL)
+			continue;
+		flush_dcache_page(page[i]);
+		if (res < 0)
+			SetPageError(page[i]);
+		else
+			SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		put_page(page[i]);
+	}
+
+	return res;
+}
+
 
-static int squashfs_read_cache(struct page *target_page, u64 block, int bsize,
-	int pages, struct page **page, int bytes)
+static int squashfs_read_cache(struct inode *i, struct page *target_page,
+	u64 block, int bsize, int pages, struct page **page, int bytes)
 {
-	struct inode *i = target_page->mapping->host;
 	struct squashfs_cache_entry *buffer = squashfs_get_datablock(i->i_sb,
 						 block, bsize);
 	int res = buffer->error, n, offset = 0;
@@ -70,9 +70,14 @@ extern __le64 *squashfs_read_fragment_index_table(struct super_block *,
 void squashfs_fill_page(struct page *, struct squashfs_cache_entry *, int, int);
 void squashfs_copy_cache(struct page *, struct squashfs_cache_entry *, int,
 				int);
+extern int squashfs_init_read_wq(void);
+extern void squashfs_destroy_read_wq(void);
+extern void squashfs_flush_read_wq(void);
 
 /* file_xxx.c */
 extern int squashfs_readpage_block(struct page *, u64, int, int);
+extern int squashfs_readpages_block(struct inode *, u64, int, int,
+				struct page **, int);
 
 /* id.c */
 extern int squashfs_get_id(struct super_block *, unsigned int, unsigned int *);
@@ -176,6 +176,19 @@ struct backing_dev_info {
 
 	struct timer_list laptop_mode_wb_timer;
 
+#ifdef CONFIG_BLK_DIRTY_LAT
+	/*
+	 * Latency-targeted dirty throttling, driven by the device queue.
+	 * Each step halves the dirty threshold and the writeback chunk
+	 * size of this bdi.
+	 */
+	unsigned int dirty_lat_step;
+	u64 dirty_lat_read_nsec;	/* mean latencies of the last window */
+	u64 dirty_lat_write_nsec;
+	unsigned long dirty_lat_throttled;	/* steps up */
+	unsigned long dirty_lat_relaxed;	/* steps down */
+#endif
+
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *debug_dir;
 	struct dentry *debug_stats;
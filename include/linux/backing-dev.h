@@ -187,6 +187,15 @@ static inline bool bdi_cap_synchronous_io(struct backing_dev_info *bdi)
 	return bdi->capabilities & BDI_CAP_SYNCHRONOUS_IO;
 }
 
+static inline unsigned int bdi_dirty_lat_step(struct backing_dev_info *bdi)
+{
+#ifdef CONFIG_BLK_DIRTY_LAT
+	return READ_ONCE(bdi->dirty_lat_step);
+#else
+	return 0;
+#endif
+}
+
 static inline bool bdi_cap_stable_pages_required(struct backing_dev_info *bdi)
 {
 	return bdi->capabilities & BDI_CAP_STABLE_WRITES;
@@ -412,6 +412,7 @@ extern struct bio_set *bioset_create(unsigned int, unsigned int, int flags);
 enum {
 	BIOSET_NEED_BVECS = BIT(0),
 	BIOSET_NEED_RESCUER = BIT(1),
+	BIOSET_PERCPU_CACHE = BIT(2),
 };
 extern void bioset_free(struct bio_set *);
 extern mempool_t *biovec_create_pool(int pool_entries);
@@ -758,6 +759,18 @@ struct bio_set {
 	struct bio_list		rescue_list;
 	struct work_struct	rescue_work;
 	struct workqueue_struct	*rescue_workqueue;
+
+	/*
+	 * Per-cpu cache of freed bios with inline vecs, see
+	 * %BIOSET_PERCPU_CACHE
+	 */
+	struct bio_alloc_cache __percpu *cache;
+	struct hlist_node	cpuhp_dead;
+};
+
+struct bio_alloc_cache {
+	struct bio		*free_list;
+	unsigned int		nr;
 };
 
 struct biovec_slab {
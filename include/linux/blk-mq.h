@@ -42,6 +42,9 @@ struct blk_mq_hw_ctx {
 
 	unsigned long		queued;
 	unsigned long		run;
+	/* tags taken from / waits on the share kept for BLK_MQ_REQ_PRIO */
+	unsigned long		prio_tag_hits;
+	unsigned long		prio_tag_waits;
 #define BLK_MQ_MAX_DISPATCH_ORDER	7
 	unsigned long		dispatched[BLK_MQ_MAX_DISPATCH_ORDER];
 
@@ -201,6 +204,7 @@ enum {
 	BLK_MQ_REQ_NOWAIT	= (1 << 0), /* return when out of requests */
 	BLK_MQ_REQ_RESERVED	= (1 << 1), /* allocate from reserved pool */
 	BLK_MQ_REQ_INTERNAL	= (1 << 2), /* allocate internal/sched tag */
+	BLK_MQ_REQ_PRIO		= (1 << 3), /* may use tags kept for sync/RT I/O */
 };
 
 struct request *blk_mq_alloc_request(struct request_queue *q, unsigned int op,
@@ -16,6 +16,7 @@ struct page;
 struct block_device;
 struct io_context;
 struct cgroup_subsys_state;
+struct blkcg_gq;
 typedef void (bio_end_io_t) (struct bio *);
 
 /*
@@ -94,6 +95,10 @@ struct bio {
 	void			*bi_cg_private;
 	struct blk_issue_stat	bi_issue_stat;
 #endif
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+	struct blkcg_gq		*bi_iolat_blkg;	/* blkg charged by io.latency */
+	u64			bi_iolat_start;	/* issue time, ns */
+#endif
 #endif
 	union {
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
@@ -149,6 +154,7 @@ struct bio {
 				 * throttling rules. Don't do it again. */
 #define BIO_TRACE_COMPLETION 10	/* bio_endio() should trace the final completion
 				 * of this bio. */
+#define BIO_PERCPU_CACHE 11	/* can be recycled into bi_pool's per-cpu cache */
 /* See BVEC_POOL_OFFSET below before adding new flags */
 
 /*
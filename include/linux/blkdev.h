@@ -41,6 +41,7 @@ struct blkcg_gq;
 struct blk_flush_queue;
 struct pr_ops;
 struct rq_wb;
+struct rq_dirty_lat;
 struct blk_queue_stats;
 struct blk_stat_callback;
 
@@ -54,7 +55,7 @@ struct blk_stat_callback;
  * Maximum number of blkcg policies allowed to be registered concurrently.
  * Defined here to simplify include dependency.
  */
-#define BLKCG_MAX_POLS		3
+#define BLKCG_MAX_POLS		4
 
 static inline int blk_validate_block_size(unsigned int bsize)
 {
@@ -220,6 +221,10 @@ struct request {
 	struct request_list *rl;		/* rl this rq is alloced from */
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
+#endif
+#ifdef CONFIG_BLK_DEBUG_FS
+	u64 alloc_time_ns;		/* for the latency histograms */
+	unsigned int stats_sectors;	/* size when started, ditto */
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -430,6 +435,9 @@ struct request_queue {
 
 	struct blk_queue_stats	*stats;
 	struct rq_wb		*rq_wb;
+#ifdef CONFIG_BLK_DIRTY_LAT
+	struct rq_dirty_lat	*rq_dirty_lat;
+#endif
 
 	/*
 	 * If blkcg is not used, @q->root_rl serves all requests.  If blkcg
@@ -561,6 +569,9 @@ struct request_queue {
 	unsigned int		rq_timeout;
 	int			poll_nsec;
 
+	/* percentage of blk-mq tags only sync/RT/protected I/O may use */
+	unsigned int		prio_tag_reserve;
+
 	struct blk_stat_callback	*poll_cb;
 	struct blk_rq_stat	poll_stat[BLK_MQ_POLL_STATS_BKTS];
 
@@ -1326,8 +1337,11 @@ struct blk_plug {
 	struct list_head list; /* requests */
 	struct list_head mq_list; /* blk-mq requests */
 	struct list_head cb_list; /* md requires an unplug callback */
+	struct list_head mq_cached_list; /* pre-allocated blk-mq requests */
+	bool mq_alloc_batch; /* batch further blk-mq request allocations */
 };
 #define BLK_MAX_REQUEST_COUNT 16
+#define BLK_PLUG_RQ_BATCH 8
 #define BLK_PLUG_FLUSH_SIZE (128 * 1024)
 
 struct blk_plug_cb;
@@ -1366,6 +1380,7 @@ static inline bool blk_needs_flush_plug(struct task_struct *tsk)
 	return plug &&
 		(!list_empty(&plug->list) ||
 		 !list_empty(&plug->mq_list) ||
+		 !list_empty(&plug->mq_cached_list) ||
 		 !list_empty(&plug->cb_list));
 }
 
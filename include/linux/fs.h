@@ -840,6 +840,19 @@ struct fown_struct {
 	int signum;		/* posix.1b rt signal to be delivered on IO */
 };
 
+/*
+ * Number of sequential streams per file whose readahead windows are kept
+ * track of: the current one in struct file_ra_state, the others in
+ * ->streams[].
+ */
+#define RA_STREAMS	3
+
+struct file_ra_stream {
+	pgoff_t start;
+	unsigned int size;
+	unsigned int async_size;
+};
+
 /*
  * Track a single file's readahead state
  */
@@ -852,6 +865,15 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	/* windows of streams interleaved with the current one, newest first */
+	struct file_ra_stream streams[RA_STREAMS - 1];
+	pgoff_t last_miss;		/* offset of the last random miss */
+	long stride;			/* distance between the last misses */
+	unsigned int stride_count;	/* # of misses at that distance */
+
+	unsigned int hits;		/* readahead windows that were used */
+	unsigned int waste;		/* pages read ahead for nothing */
 };
 
 /*
@@ -1441,6 +1463,14 @@ struct super_block {
 	 */
 	struct user_namespace *s_user_ns;
 
+	/*
+	 * All dentries and unused negative dentries of this sb, for the
+	 * negative dentry budget; trimmed by s_dentry_trim_work.
+	 */
+	struct percpu_counter	s_nr_dentry;
+	struct percpu_counter	s_nr_dentry_negative;
+	struct work_struct	s_dentry_trim_work;
+
 	/*
 	 * Keep the lru lists last in the structure so they always sit on their
 	 * own individual cachelines.
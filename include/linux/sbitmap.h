@@ -357,6 +357,20 @@ int __sbitmap_queue_get(struct sbitmap_queue *sbq);
 int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 				unsigned int shallow_depth);
 
+/**
+ * __sbitmap_queue_get_batch() - Try to allocate a batch of free bits from a
+ * single word of a &struct sbitmap_queue with preemption already disabled.
+ * @sbq: Bitmap queue to allocate from.
+ * @nr_bits: Maximum number of bits to allocate, at most BITS_PER_LONG.
+ * @offset: Output parameter; bit number of bit 0 of the returned mask.
+ *
+ * Return: Mask of the allocated bits relative to @offset, 0 if none could be
+ * allocated. Each bit has to be freed with sbitmap_queue_clear().
+ */
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq,
+					unsigned int nr_bits,
+					unsigned int *offset);
+
 /**
  * sbitmap_queue_get() - Try to allocate a free bit from a &struct
  * sbitmap_queue.
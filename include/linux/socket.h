@@ -345,12 +345,23 @@ extern int move_addr_to_kernel(void __user *uaddr, int ulen, struct sockaddr_sto
 extern int put_cmsg(struct msghdr*, int level, int type, int len, void *data);
 
 struct timespec;
+struct socket;
+struct file;
 
 /* The __sys_...msg variants allow MSG_CMSG_COMPAT */
 extern long __sys_recvmsg(int fd, struct user_msghdr __user *msg, unsigned flags);
 extern long __sys_sendmsg(int fd, struct user_msghdr __user *msg, unsigned flags);
+extern long __sys_recvmsg_sock(struct socket *sock,
+			       struct user_msghdr __user *msg,
+			       unsigned int flags);
+extern long __sys_sendmsg_sock(struct socket *sock,
+			       struct user_msghdr __user *msg,
+			       unsigned int flags);
 extern int __sys_recvmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen,
 			  unsigned int flags, struct timespec *timeout);
 extern int __sys_sendmmsg(int fd, struct mmsghdr __user *mmsg,
 			  unsigned int vlen, unsigned int flags);
+extern int __sys_accept4_file(struct file *file, unsigned file_flags,
+			      struct sockaddr __user *upeer_sockaddr,
+			      int __user *upeer_addrlen, int flags);
 #endif /* _LINUX_SOCKET_H */
@@ -142,6 +142,7 @@ struct inet_cork {
 	__s16			tos;
 	char			priority;
 	__u16			gso_size;
+	u64			transmit_time;	/* SCM_TXTIME, CLOCK_MONOTONIC ns */
 };
 
 struct inet_cork_full {
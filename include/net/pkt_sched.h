@@ -111,8 +111,19 @@ void __qdisc_run(struct Qdisc *q);
 
 static inline void qdisc_run(struct Qdisc *q)
 {
-	if (qdisc_run_begin(q))
-		__qdisc_run(q);
+	if (qdisc_run_begin(q)) {
+		/* A NOLOCK qdisc is not serialized by its root lock, so
+		 * deactivation is only seen reliably under the seqlock.
+		 * Nothing will be sent from it any more: drop pending
+		 * MISSED requests rather than rescheduling forever.
+		 */
+		if (unlikely(q->flags & TCQ_F_NOLOCK &&
+			     test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+			clear_bit(__QDISC_STATE_MISSED, &q->state);
+			qdisc_run_end(q);
+		} else
+			__qdisc_run(q);
+	}
 }
 
 static inline __be16 tc_skb_protocol(const struct sk_buff *skb)
@@ -747,9 +747,12 @@ void tcp_send_window_probe(struct sock *sk);
  */
 #define TCP_TS_HZ	1000
 
+/* CLOCK_MONOTONIC, so that departure times stamped by TCP can be
+ * compared by sch_fq and armed on hrtimers as they are.
+ */
 static inline u64 tcp_clock_ns(void)
 {
-	return local_clock();
+	return ktime_get_ns();
 }
 
 static inline u64 tcp_clock_us(void)
@@ -775,8 +778,12 @@ static inline u32 tcp_time_stamp_raw(void)
  */
 static inline void tcp_mstamp_refresh(struct tcp_sock *tp)
 {
-	u64 val = tcp_clock_us();
+	u64 val = tcp_clock_ns();
+
+	if (val > tp->tcp_clock_cache)
+		tp->tcp_clock_cache = val;
 
+	val = div_u64(val, NSEC_PER_USEC);
 	if (val > tp->tcp_mstamp)
 		tp->tcp_mstamp = val;
 }
@@ -2084,6 +2091,8 @@ static inline int tcp_inq(struct sock *sk)
 }
 
 int tcp_peek_len(struct socket *sock);
+int tcp_mmap(struct file *file, struct socket *sock,
+	     struct vm_area_struct *vma);
 
 static inline void tcp_segs_in(struct tcp_sock *tp, const struct sk_buff *skb)
 {
@@ -36,6 +36,28 @@ TRACE_EVENT(napi_poll,
 		  __entry->work, __entry->budget)
 );
 
+TRACE_EVENT(napi_rx_list,
+
+	TP_PROTO(struct napi_struct *napi, int count),
+
+	TP_ARGS(napi, count),
+
+	TP_STRUCT__entry(
+		__field(	struct napi_struct *,	napi)
+		__string(	dev_name, napi->dev ? napi->dev->name : NO_DEV)
+		__field(	int,			count)
+	),
+
+	TP_fast_assign(
+		__entry->napi = napi;
+		__assign_str(dev_name, napi->dev ? napi->dev->name : NO_DEV);
+		__entry->count = count;
+	),
+
+	TP_printk("napi rx list on napi struct %p for device %s count %d",
+		  __entry->napi, __get_str(dev_name), __entry->count)
+);
+
 #undef NO_DEV
 
 #endif /* _TRACE_NAPI_H_ */
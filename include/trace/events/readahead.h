@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+#include <linux/kdev_t.h>
+
+#ifndef __RA_PATTERN_DEFINED
+#define __RA_PATTERN_DEFINED
+/*
+ * How ondemand_readahead() classified an access
+ */
+enum ra_pattern {
+	RA_PATTERN_INITIAL,	/* start of a new sequential window */
+	RA_PATTERN_SEQUENTIAL,	/* continuation of the current window */
+	RA_PATTERN_STREAM,	/* continuation of a saved interleaved window */
+	RA_PATTERN_MARKER,	/* marker hit without window state */
+	RA_PATTERN_CONTEXT,	/* sequential run found in the page cache */
+	RA_PATTERN_STRIDE,	/* misses at a constant distance */
+	RA_PATTERN_RANDOM,	/* standalone random read */
+};
+#endif
+
+TRACE_DEFINE_ENUM(RA_PATTERN_INITIAL);
+TRACE_DEFINE_ENUM(RA_PATTERN_SEQUENTIAL);
+TRACE_DEFINE_ENUM(RA_PATTERN_STREAM);
+TRACE_DEFINE_ENUM(RA_PATTERN_MARKER);
+TRACE_DEFINE_ENUM(RA_PATTERN_CONTEXT);
+TRACE_DEFINE_ENUM(RA_PATTERN_STRIDE);
+TRACE_DEFINE_ENUM(RA_PATTERN_RANDOM);
+
+#define show_ra_pattern(p)						\
+	__print_symbolic(p,						\
+		{ RA_PATTERN_INITIAL,		"initial" },		\
+		{ RA_PATTERN_SEQUENTIAL,	"sequential" },		\
+		{ RA_PATTERN_STREAM,		"stream" },		\
+		{ RA_PATTERN_MARKER,		"marker" },		\
+		{ RA_PATTERN_CONTEXT,		"context" },		\
+		{ RA_PATTERN_STRIDE,		"stride" },		\
+		{ RA_PATTERN_RANDOM,		"random" })
+
+TRACE_EVENT(ondemand_readahead,
+
+	TP_PROTO(struct address_space *mapping, struct file_ra_state *ra,
+		 pgoff_t offset, unsigned long req_size, int pattern,
+		 unsigned long nr_pages),
+
+	TP_ARGS(mapping, ra, offset, req_size, pattern, nr_pages),
+
+	TP_STRUCT__entry(
+		__field(dev_t, s_dev)
+		__field(unsigned long, i_ino)
+		__field(pgoff_t, offset)
+		__field(unsigned long, req_size)
+		__field(int, pattern)
+		__field(pgoff_t, start)
+		__field(unsigned int, size)
+		__field(unsigned int, async_size)
+		__field(long, stride)
+		__field(unsigned long, nr_pages)
+		__field(unsigned int, hits)
+		__field(unsigned int, waste)
+	),
+
+	TP_fast_assign(
+		__entry->s_dev = mapping->host->i_sb->s_dev;
+		__entry->i_ino = mapping->host->i_ino;
+		__entry->offset = offset;
+		__entry->req_size = req_size;
+		__entry->pattern = pattern;
+		__entry->start = ra->start;
+		__entry->size = ra->size;
+		__entry->async_size = ra->async_size;
+		__entry->stride = ra->stride;
+		__entry->nr_pages = nr_pages;
+		__entry->hits = ra->hits;
+		__entry->waste = ra->waste;
+	),
+
+	TP_printk("dev %d:%d ino %lx ofs=%lu req=%lu %s window=%lu+%u async=%u stride=%ld submitted=%lu hits=%u waste=%u",
+		MAJOR(__entry->s_dev), MINOR(__entry->s_dev),
+		__entry->i_ino, __entry->offset, __entry->req_size,
+		show_ra_pattern(__entry->pattern),
+		__entry->start, __entry->size, __entry->async_size,
+		__entry->stride, __entry->nr_pages,
+		__entry->hits, __entry->waste)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -85,14 +85,17 @@ TRACE_EVENT(wbt_lat,
  * @bg: the current background queue limit
  * @normal: the current normal writeback limit
  * @max: the current max throughput writeback limit
+ * @lp_step: the extra scale step of low priority writeback
+ * @lowprio: the current low priority writeback limit
  */
 TRACE_EVENT(wbt_step,
 
 	TP_PROTO(struct backing_dev_info *bdi, const char *msg,
 		 int step, unsigned long window, unsigned int bg,
-		 unsigned int normal, unsigned int max),
+		 unsigned int normal, unsigned int max, int lp_step,
+		 unsigned int lowprio),
 
-	TP_ARGS(bdi, msg, step, window, bg, normal, max),
+	TP_ARGS(bdi, msg, step, window, bg, normal, max, lp_step, lowprio),
 
 	TP_STRUCT__entry(
 		__array(char, name, 32)
@@ -102,6 +105,8 @@ TRACE_EVENT(wbt_step,
 		__field(unsigned int, bg)
 		__field(unsigned int, normal)
 		__field(unsigned int, max)
+		__field(int, lp_step)
+		__field(unsigned int, lowprio)
 	),
 
 	TP_fast_assign(
@@ -113,11 +118,14 @@ TRACE_EVENT(wbt_step,
 		__entry->bg	= bg;
 		__entry->normal	= normal;
 		__entry->max	= max;
+		__entry->lp_step = lp_step;
+		__entry->lowprio = lowprio;
 	),
 
-	TP_printk("%s: %s: step=%d, window=%luus, background=%u, normal=%u, max=%u\n",
+	TP_printk("%s: %s: step=%d, window=%luus, background=%u, normal=%u, max=%u, lowprio_step=%d, lowprio=%u\n",
 		  __entry->name, __entry->msg, __entry->step, __entry->window,
-		  __entry->bg, __entry->normal, __entry->max)
+		  __entry->bg, __entry->normal, __entry->max, __entry->lp_step,
+		  __entry->lowprio)
 );
 
 /**
@@ -733,8 +733,28 @@ __SYSCALL(__NR_pkey_free,     sys_pkey_free)
 #define __NR_statx 291
 __SYSCALL(__NR_statx,     sys_statx)
 
+/*
+ * Numbers 292 to 424 are left unused here so that the io_uring calls keep
+ * the numbers they have upstream.
+ */
+#define __NR_io_uring_setup 425
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 426
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_io_uring_register 427
+__SYSCALL(__NR_io_uring_register, sys_io_uring_register)
+
+/*
+ * Calls that do not exist upstream are numbered from 1000 on, well away
+ * from the range upstream keeps allocating from.
+ */
+#define __NR_epoll_ctl_batch 1000
+__SYSCALL(__NR_epoll_ctl_batch, sys_epoll_ctl_batch)
+#define __NR_getdents64_statx 1001
+__SYSCALL(__NR_getdents64_statx, sys_getdents64_statx)
+
 #undef __NR_syscalls
-#define __NR_syscalls 292
+#define __NR_syscalls 1002
 
 /*
  * All syscalls below here should go away really,
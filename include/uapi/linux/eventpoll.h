@@ -27,6 +27,17 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/* One command for sys_epoll_ctl_batch() */
+struct epoll_ctl_cmd {
+	__u32 flags;		/* reserved, must be zero */
+	__s32 op;		/* EPOLL_CTL_ADD, EPOLL_CTL_DEL or EPOLL_CTL_MOD */
+	__s32 fd;		/* target file descriptor */
+	__u32 events;		/* as in struct epoll_event */
+	__u64 data;		/* as in struct epoll_event */
+	__s32 result;		/* set to the result of this command */
+	__u32 __pad;
+};
+
 /* Epoll event masks */
 #define EPOLLIN		0x00000001
 #define EPOLLPRI	0x00000002
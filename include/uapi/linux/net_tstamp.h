@@ -141,4 +141,14 @@ struct scm_ts_pktinfo {
 	__u32 reserved[2];
 };
 
+/*
+ * SO_TXTIME gets a struct sock_txtime. Packets sent with an SCM_TXTIME
+ * control message carry that departure time, in nanoseconds of clockid,
+ * down to the packet scheduler. Only CLOCK_MONOTONIC is supported.
+ */
+struct sock_txtime {
+	__kernel_clockid_t	clockid;/* reference clockid */
+	__u32			flags;	/* reserved, must be zero */
+};
+
 #endif /* _NET_TIMESTAMPING_H */
@@ -170,5 +170,45 @@ struct statx {
 
 #define STATX_ATTR_AUTOMOUNT		0x00001000 /* Dir: Automount trigger */
 
+/*
+ * Directory entry returned by getdents64_statx().
+ *
+ * Each record carries the attributes requested in the mask argument; d_mask
+ * says which of them were actually filled in, with the same STATX_* meaning
+ * as stx_mask.  It is zero if the entry could not be looked up, e.g. because
+ * it was unlinked after the directory was read.  Records are d_reclen bytes
+ * long and 8-byte aligned.
+ */
+struct linux_dirent64_statx {
+	/* 0x00 */
+	__u64	d_ino;		/* Inode number as reported by readdir */
+	__s64	d_off;		/* Offset to the next record */
+	/* 0x10 */
+	__u16	d_reclen;	/* Length of this record */
+	__u8	d_type;		/* DT_* type of the entry */
+	__u8	__spare0[1];
+	__u32	d_mask;		/* What attributes were written */
+	__u32	d_nlink;
+	__u32	d_uid;
+	/* 0x20 */
+	__u32	d_gid;
+	__u16	d_mode;
+	__u16	__spare1[1];
+	__u64	d_size;
+	/* 0x30 */
+	__u64	d_blocks;
+	struct statx_timestamp	d_atime;
+	struct statx_timestamp	d_btime;
+	struct statx_timestamp	d_ctime;
+	struct statx_timestamp	d_mtime;
+	/* 0x78 */
+	__u32	d_rdev_major;
+	__u32	d_rdev_minor;
+	__u32	d_dev_major;
+	__u32	d_dev_minor;
+	/* 0x88 */
+	char	d_name[];
+};
+
 
 #endif /* _UAPI_LINUX_STAT_H */
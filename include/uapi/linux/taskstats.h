@@ -183,6 +183,78 @@ struct taskstats2 {
 	/* version 1 ends here */
 };
 
+#define TASKSTATS_BULK_VERSION	1
+
+/*
+ * Groups of fields in struct taskstats_bulk, selected with
+ * TASKSTATS_CMD_ATTR_BULK_MASK and reported back in taskstats_bulk.mask.
+ */
+#define TASKSTATS_BULK_ID	(1U << 0)	/* ids, state, comm */
+#define TASKSTATS_BULK_CPU	(1U << 1)	/* times, faults, switches */
+#define TASKSTATS_BULK_STATM	(1U << 2)	/* /proc/<pid>/statm */
+#define TASKSTATS_BULK_MEM	(1U << 3)	/* Vm and Rss lines of status */
+#define TASKSTATS_BULK_IO	(1U << 4)	/* /proc/<pid>/io */
+#define TASKSTATS_BULK_ALL	(TASKSTATS_BULK_ID | TASKSTATS_BULK_CPU | \
+				 TASKSTATS_BULK_STATM | TASKSTATS_BULK_MEM | \
+				 TASKSTATS_BULK_IO)
+
+/*
+ * One record per process of a TASKSTATS_BULK_CMD_GET dump. All counters
+ * cover the whole thread group. Fields of groups missing from mask are 0.
+ */
+struct taskstats_bulk {
+	__u16	version;
+	__u16	__pad0;
+	__u32	mask;		/* TASKSTATS_BULK_* groups filled in */
+	__u32	pid;		/* thread group id */
+
+	/* TASKSTATS_BULK_ID */
+	__u32	ppid;
+	__u32	uid;		/* real uid */
+	__u32	euid;		/* effective uid */
+	__u32	nr_threads;
+	__s16	oom_score_adj;
+	__u8	state;		/* state letter, as in /proc/<pid>/stat */
+	__u8	__pad1;
+	char	comm[TS_COMM_LEN];
+
+	/* TASKSTATS_BULK_CPU */
+	__u64	utime;		/* ns */
+	__u64	stime;		/* ns */
+	__u64	start_time;	/* ns since boot */
+	__u64	min_flt;
+	__u64	maj_flt;
+	__u64	nvcsw;
+	__u64	nivcsw;
+
+	/* TASKSTATS_BULK_STATM, in pages */
+	__u64	statm_size;
+	__u64	statm_resident;
+	__u64	statm_shared;
+	__u64	statm_text;
+	__u64	statm_data;
+
+	/* TASKSTATS_BULK_MEM, in KB */
+	__u64	hiwater_rss;
+	__u64	anon_rss;
+	__u64	file_rss;
+	__u64	shmem_rss;
+	__u64	swap;
+	__u64	locked_vm;
+	__u64	pte;
+	__u64	unreclaimable;
+
+	/* TASKSTATS_BULK_IO */
+	__u64	rchar;
+	__u64	wchar;
+	__u64	syscr;
+	__u64	syscw;
+	__u64	read_bytes;
+	__u64	write_bytes;
+	__u64	cancelled_write_bytes;
+	/* version 1 ends here */
+};
+
 /*
  * Commands sent from userspace
  * Not versioned. New commands should only be inserted at the enum's end
@@ -199,6 +271,14 @@ enum {
 
 #define TASKSTATS_CMD_MAX (__TASKSTATS_CMD_MAX - 1)
 
+/*
+ * The cgroupstats and sysstats commands are numbered after the ones above
+ * in the same family, so later taskstats commands go after SYSSTATS_CMD_NEW.
+ */
+enum {
+	TASKSTATS_BULK_CMD_GET = 10,	/* user->kernel dump request */
+};
+
 enum {
 	TASKSTATS_TYPE_UNSPEC = 0,	/* Reserved */
 	TASKSTATS_TYPE_PID,		/* Process id */
@@ -208,6 +288,7 @@ enum {
 	TASKSTATS_TYPE_AGGR_TGID,	/* contains tgid + stats */
 	TASKSTATS_TYPE_NULL,		/* contains nothing */
 	TASKSTATS_TYPE_FOREACH,		/* contains stats */
+	TASKSTATS_TYPE_BULK,		/* contains taskstats_bulk */
 	__TASKSTATS_TYPE_MAX,
 };
 
@@ -220,6 +301,9 @@ enum {
 	TASKSTATS_CMD_ATTR_REGISTER_CPUMASK,
 	TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK,
 	TASKSTATS_CMD_ATTR_FOREACH,
+	TASKSTATS_CMD_ATTR_BULK_MASK,		/* u32 TASKSTATS_BULK_* */
+	TASKSTATS_CMD_ATTR_BULK_CGROUP_FD,	/* u32 fd of a cgroup dir */
+	TASKSTATS_CMD_ATTR_BULK_PIDS,		/* array of u32 pids */
 	__TASKSTATS_CMD_ATTR_MAX,
 };
 
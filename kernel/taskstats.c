@@ -34,7 +34,10 @@
 #include <net/genetlink.h>
 #include <linux/atomic.h>
 #include <linux/sched/cputime.h>
+#include <linux/sched/mm.h>
 #include <linux/oom.h>
+#include <linux/proc_fs.h>
+#include <linux/task_io_accounting_ops.h>
 
 /*
  * Maximum length of a cpumask that can be specified in
@@ -63,6 +66,13 @@ static const struct nla_policy cgroupstats_cmd_get_policy[TASKSTATS_CMD_ATTR_MAX
 	[CGROUPSTATS_CMD_ATTR_FD] = { .type = NLA_U32 },
 };
 
+static const struct nla_policy
+		taskstats_bulk_cmd_get_policy[TASKSTATS_CMD_ATTR_MAX+1] = {
+	[TASKSTATS_CMD_ATTR_BULK_MASK] = { .type = NLA_U32 },
+	[TASKSTATS_CMD_ATTR_BULK_CGROUP_FD] = { .type = NLA_U32 },
+	[TASKSTATS_CMD_ATTR_BULK_PIDS] = { .type = NLA_BINARY },
+};
+
 static const struct nla_policy
 		sysstats_cmd_get_policy[TASKSTATS_CMD_ATTR_MAX+1] = {
 	[SYSSTATS_CMD_ATTR_SYSMEM_STATS] = { .type = NLA_U32 },
@@ -861,6 +871,342 @@ static int taskstats2_foreach(struct sk_buff *skb, struct netlink_callback *cb)
 	return skb->len;
 }
 
+/*
+ * State of a TASKSTATS_BULK_CMD_GET dump, hung off cb->args[1]. With
+ * @all set cb->args[0] is the next tgid to look at, otherwise it is the
+ * next index into @pids.
+ */
+struct taskstats_bulk_dump {
+	u32 mask;
+	bool all;
+	unsigned int nr_pids;
+	u32 pids[];
+};
+
+static struct taskstats_bulk_dump *taskstats_bulk_alloc(unsigned int nr)
+{
+	return kvzalloc(sizeof(struct taskstats_bulk_dump) + nr * sizeof(u32),
+			GFP_KERNEL);
+}
+
+#ifdef CONFIG_CGROUPS
+/* Snapshot the processes of the cgroup whose directory @fd refers to */
+static struct taskstats_bulk_dump *taskstats_bulk_cgroup(u32 fd)
+{
+	struct pid_namespace *ns = task_active_pid_ns(current);
+	struct taskstats_bulk_dump *dump, *bigger;
+	struct cgroup_subsys_state *css;
+	struct css_task_iter it;
+	struct task_struct *tsk;
+	unsigned int size = 64;
+	struct fd f;
+
+	f = fdget(fd);
+	if (!f.file)
+		return ERR_PTR(-EBADF);
+	css = css_tryget_online_from_dir(f.file->f_path.dentry, NULL);
+	fdput(f);
+	if (IS_ERR(css))
+		return ERR_CAST(css);
+
+	dump = taskstats_bulk_alloc(size);
+	if (!dump)
+		goto nomem;
+
+	css_task_iter_start(css, CSS_TASK_ITER_PROCS, &it);
+	while ((tsk = css_task_iter_next(&it))) {
+		if (dump->nr_pids == size) {
+			bigger = taskstats_bulk_alloc(size * 2);
+			if (!bigger) {
+				css_task_iter_end(&it);
+				kvfree(dump);
+				goto nomem;
+			}
+			memcpy(bigger->pids, dump->pids, size * sizeof(u32));
+			bigger->nr_pids = size;
+			kvfree(dump);
+			dump = bigger;
+			size *= 2;
+		}
+		dump->pids[dump->nr_pids] = task_tgid_nr_ns(tsk, ns);
+		if (dump->pids[dump->nr_pids])
+			dump->nr_pids++;
+	}
+	css_task_iter_end(&it);
+	css_put(css);
+	return dump;
+nomem:
+	css_put(css);
+	return ERR_PTR(-ENOMEM);
+}
+#else
+static struct taskstats_bulk_dump *taskstats_bulk_cgroup(u32 fd)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+#endif
+
+static int taskstats_bulk_start(struct netlink_callback *cb)
+{
+	struct nlattr *attrs[TASKSTATS_CMD_ATTR_MAX + 1];
+	struct taskstats_bulk_dump *dump;
+	struct nlattr *na;
+	u32 mask = TASKSTATS_BULK_ALL;
+	int rc;
+
+	rc = nlmsg_parse(cb->nlh, GENL_HDRLEN, attrs, TASKSTATS_CMD_ATTR_MAX,
+			 taskstats_bulk_cmd_get_policy, NULL);
+	if (rc < 0)
+		return rc;
+
+	if (attrs[TASKSTATS_CMD_ATTR_BULK_MASK])
+		mask = nla_get_u32(attrs[TASKSTATS_CMD_ATTR_BULK_MASK]);
+	if (mask & ~TASKSTATS_BULK_ALL)
+		return -EINVAL;
+	if (attrs[TASKSTATS_CMD_ATTR_BULK_PIDS] &&
+	    attrs[TASKSTATS_CMD_ATTR_BULK_CGROUP_FD])
+		return -EINVAL;
+
+	na = attrs[TASKSTATS_CMD_ATTR_BULK_PIDS];
+	if (na) {
+		if (!nla_len(na) || nla_len(na) % sizeof(u32))
+			return -EINVAL;
+		dump = taskstats_bulk_alloc(nla_len(na) / sizeof(u32));
+		if (!dump)
+			return -ENOMEM;
+		dump->nr_pids = nla_len(na) / sizeof(u32);
+		memcpy(dump->pids, nla_data(na), nla_len(na));
+	} else if (attrs[TASKSTATS_CMD_ATTR_BULK_CGROUP_FD]) {
+		dump = taskstats_bulk_cgroup(
+			nla_get_u32(attrs[TASKSTATS_CMD_ATTR_BULK_CGROUP_FD]));
+		if (IS_ERR(dump))
+			return PTR_ERR(dump);
+	} else {
+		dump = taskstats_bulk_alloc(0);
+		if (!dump)
+			return -ENOMEM;
+		dump->all = true;
+	}
+
+	dump->mask = mask;
+	cb->args[0] = 0;
+	cb->args[1] = (long)dump;
+	return 0;
+}
+
+static int taskstats_bulk_done(struct netlink_callback *cb)
+{
+	kvfree((void *)cb->args[1]);
+	return 0;
+}
+
+static void taskstats_bulk_fill_id(struct task_struct *tsk,
+				   struct taskstats_bulk *stats)
+{
+	struct user_namespace *user_ns = current_user_ns();
+	const struct cred *cred;
+
+	rcu_read_lock();
+	if (pid_alive(tsk))
+		stats->ppid = task_tgid_nr_ns(rcu_dereference(tsk->real_parent),
+					      task_active_pid_ns(current));
+	cred = __task_cred(tsk);
+	stats->uid = from_kuid_munged(user_ns, cred->uid);
+	stats->euid = from_kuid_munged(user_ns, cred->euid);
+	rcu_read_unlock();
+
+	stats->nr_threads = get_nr_threads(tsk);
+	stats->oom_score_adj = tsk->signal->oom_score_adj;
+	stats->state = task_state_to_char(tsk);
+	__get_task_comm(stats->comm, sizeof(stats->comm), tsk);
+	stats->mask |= TASKSTATS_BULK_ID;
+}
+
+/* Same sums as the whole-group case of do_task_stat() */
+static void taskstats_bulk_fill_cpu(struct task_struct *tsk,
+				    struct taskstats_bulk *stats)
+{
+	struct task_struct *t = tsk;
+	unsigned long flags;
+	u64 utime, stime;
+
+	if (!lock_task_sighand(tsk, &flags))
+		return;
+	stats->min_flt = tsk->signal->min_flt;
+	stats->maj_flt = tsk->signal->maj_flt;
+	stats->nvcsw = tsk->signal->nvcsw;
+	stats->nivcsw = tsk->signal->nivcsw;
+	do {
+		stats->min_flt += t->min_flt;
+		stats->maj_flt += t->maj_flt;
+		stats->nvcsw += t->nvcsw;
+		stats->nivcsw += t->nivcsw;
+	} while_each_thread(tsk, t);
+	thread_group_cputime_adjusted(tsk, &utime, &stime);
+	unlock_task_sighand(tsk, &flags);
+
+	stats->utime = utime;
+	stats->stime = stime;
+	stats->start_time = tsk->real_start_time;
+	stats->mask |= TASKSTATS_BULK_CPU;
+}
+
+static void taskstats_bulk_fill_mm(struct task_struct *tsk,
+				   struct taskstats_bulk *stats, u32 mask)
+{
+	struct mm_struct *mm = get_task_mm(tsk);
+
+	if (!mm)
+		return;
+
+#ifdef CONFIG_PROC_FS
+	if (mask & TASKSTATS_BULK_STATM) {
+		unsigned long shared, text, data, resident;
+
+		stats->statm_size = task_statm(mm, &shared, &text, &data,
+					       &resident);
+		stats->statm_resident = resident;
+		stats->statm_shared = shared;
+		stats->statm_text = text;
+		stats->statm_data = data;
+		stats->mask |= TASKSTATS_BULK_STATM;
+	}
+#endif
+
+	if (mask & TASKSTATS_BULK_MEM) {
+#define K(x) ((x) << (PAGE_SHIFT - 10))
+		stats->hiwater_rss = K(max(mm->hiwater_rss, get_mm_rss(mm)));
+		stats->anon_rss = K(get_mm_counter(mm, MM_ANONPAGES));
+		stats->file_rss = K(get_mm_counter(mm, MM_FILEPAGES));
+		stats->shmem_rss = K(get_mm_counter(mm, MM_SHMEMPAGES));
+		stats->swap = K(get_mm_counter(mm, MM_SWAPENTS));
+		stats->locked_vm = K(mm->locked_vm);
+		stats->unreclaimable =
+				K(get_mm_counter(mm, MM_UNRECLAIMABLE));
+#undef K
+		stats->pte = (PTRS_PER_PTE * sizeof(pte_t) *
+			      atomic_long_read(&mm->nr_ptes)) >> 10;
+		stats->mask |= TASKSTATS_BULK_MEM;
+	}
+
+	mmput(mm);
+}
+
+/* Same sums as the whole-group case of do_io_accounting() */
+static void taskstats_bulk_fill_io(struct task_struct *tsk,
+				   struct taskstats_bulk *stats)
+{
+	struct task_io_accounting acct = tsk->ioac;
+	struct task_struct *t = tsk;
+	unsigned long flags;
+
+	if (!lock_task_sighand(tsk, &flags))
+		return;
+	task_io_accounting_add(&acct, &tsk->signal->ioac);
+	while_each_thread(tsk, t)
+		task_io_accounting_add(&acct, &t->ioac);
+	unlock_task_sighand(tsk, &flags);
+
+#ifdef CONFIG_TASK_XACCT
+	stats->rchar = acct.rchar;
+	stats->wchar = acct.wchar;
+	stats->syscr = acct.syscr;
+	stats->syscw = acct.syscw;
+#endif
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+	stats->read_bytes = acct.read_bytes;
+	stats->write_bytes = acct.write_bytes;
+	stats->cancelled_write_bytes = acct.cancelled_write_bytes;
+#endif
+	stats->mask |= TASKSTATS_BULK_IO;
+}
+
+static struct task_struct *taskstats_bulk_next(struct pid_namespace *ns,
+					       struct taskstats_bulk_dump *dump,
+					       struct netlink_callback *cb)
+{
+	struct task_struct *tsk = NULL;
+	struct tgid_iter iter;
+
+	if (dump->all) {
+		iter.tgid = cb->args[0];
+		iter.task = NULL;
+		for (iter = next_tgid(ns, iter); iter.task;
+				iter.tgid += 1, iter = next_tgid(ns, iter)) {
+			if (!(iter.task->flags & PF_KTHREAD))
+				break;
+		}
+		cb->args[0] = iter.tgid;
+		return iter.task;
+	}
+
+	while (!tsk && cb->args[0] < dump->nr_pids) {
+		rcu_read_lock();
+		tsk = find_task_by_pid_ns(dump->pids[cb->args[0]], ns);
+		if (tsk) {
+			tsk = tsk->group_leader;
+			get_task_struct(tsk);
+		}
+		rcu_read_unlock();
+		if (!tsk)
+			cb->args[0]++;
+	}
+	return tsk;
+}
+
+/*
+ * Stream one struct taskstats_bulk per selected process: every process
+ * by default, or the ones listed in TASKSTATS_CMD_ATTR_BULK_PIDS, or the
+ * ones in the cgroup passed with TASKSTATS_CMD_ATTR_BULK_CGROUP_FD.
+ */
+static int taskstats_bulk_dumpit(struct sk_buff *skb,
+				 struct netlink_callback *cb)
+{
+	struct taskstats_bulk_dump *dump = (void *)cb->args[1];
+	struct pid_namespace *ns = task_active_pid_ns(current);
+	struct taskstats_bulk *stats;
+	struct task_struct *tsk;
+	struct nlattr *attr;
+	void *reply;
+
+	while ((tsk = taskstats_bulk_next(ns, dump, cb))) {
+		reply = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+				    cb->nlh->nlmsg_seq, &family, NLM_F_MULTI,
+				    TASKSTATS_BULK_CMD_GET);
+		if (!reply) {
+			put_task_struct(tsk);
+			break;
+		}
+		attr = nla_reserve_64bit(skb, TASKSTATS_TYPE_BULK,
+					 sizeof(struct taskstats_bulk),
+					 TASKSTATS_TYPE_NULL);
+		if (!attr) {
+			put_task_struct(tsk);
+			genlmsg_cancel(skb, reply);
+			break;
+		}
+		stats = nla_data(attr);
+		memset(stats, 0, sizeof(*stats));
+		stats->version = TASKSTATS_BULK_VERSION;
+		stats->pid = task_tgid_nr_ns(tsk, ns);
+
+		if (dump->mask & TASKSTATS_BULK_ID)
+			taskstats_bulk_fill_id(tsk, stats);
+		if (dump->mask & TASKSTATS_BULK_CPU)
+			taskstats_bulk_fill_cpu(tsk, stats);
+		if (dump->mask & (TASKSTATS_BULK_STATM | TASKSTATS_BULK_MEM))
+			taskstats_bulk_fill_mm(tsk, stats, dump->mask);
+		if (dump->mask & TASKSTATS_BULK_IO)
+			taskstats_bulk_fill_io(tsk, stats);
+
+		put_task_struct(tsk);
+		genlmsg_end(skb, reply);
+		cb->args[0]++;
+	}
+
+	return skb->len;
+}
+
 static int taskstats2_user_cmd(struct sk_buff *skb, struct genl_info *info)
 {
 	if (info->attrs[TASKSTATS_CMD_ATTR_PID])
@@ -999,6 +1345,14 @@ static const struct genl_ops taskstats_ops[] = {
 		.doit		= sysstats_user_cmd,
 		.policy		= sysstats_cmd_get_policy,
 	},
+	{
+		.cmd		= TASKSTATS_BULK_CMD_GET,
+		.start		= taskstats_bulk_start,
+		.dumpit		= taskstats_bulk_dumpit,
+		.done		= taskstats_bulk_done,
+		.policy		= taskstats_bulk_cmd_get_policy,
+		.flags		= GENL_ADMIN_PERM,
+	},
 };
 
 static struct genl_family family __ro_after_init = {
@@ -1026,6 +1380,8 @@ static int __init taskstats_init(void)
 {
 	int rc;
 
+	BUILD_BUG_ON(TASKSTATS_BULK_CMD_GET <= SYSSTATS_CMD_NEW);
+
 	rc = genl_register_family(&family);
 	if (rc)
 		return rc;
@@ -403,6 +403,65 @@ int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 }
 EXPORT_SYMBOL_GPL(__sbitmap_queue_get_shallow);
 
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq,
+					unsigned int nr_bits,
+					unsigned int *offset)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned int hint, depth, i, index;
+
+	if (unlikely(sbq->round_robin || !nr_bits))
+		return 0;
+
+	hint = this_cpu_read(*sbq->alloc_hint);
+	depth = READ_ONCE(sb->depth);
+	if (unlikely(hint >= depth)) {
+		hint = depth ? prandom_u32() % depth : 0;
+		this_cpu_write(*sbq->alloc_hint, hint);
+	}
+
+	index = SB_NR_TO_INDEX(sb, hint);
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *map = &sb->map[index];
+		unsigned long val, old, mask;
+		unsigned int nr;
+
+		/*
+		 * Grab as many of the nr_bits bits following the first free
+		 * one as are free, with a single cmpxchg on the word.
+		 */
+		nr = find_first_zero_bit(&map->word, map->depth);
+		if (nr < map->depth) {
+			unsigned int len = min(nr_bits, (unsigned int)map->depth - nr);
+
+			mask = (len == BITS_PER_LONG ? ~0UL : (1UL << len) - 1) << nr;
+			val = READ_ONCE(map->word);
+			do {
+				old = val;
+				val = cmpxchg(&map->word, old, old | mask);
+			} while (val != old);
+
+			mask &= ~old;
+			if (mask) {
+				*offset = index << sb->shift;
+				hint = (index << sb->shift) + __fls(mask) + 1;
+				if (hint >= depth - 1)
+					hint = 0;
+				this_cpu_write(*sbq->alloc_hint, hint);
+				return mask;
+			}
+		}
+
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	/* If the map is full, a hint won't do us much good. */
+	this_cpu_write(*sbq->alloc_hint, 0);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_queue_get_batch);
+
 static struct sbq_wait_state *sbq_wake_ptr(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
@@ -97,6 +97,19 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   nr_more_io,
 		   nr_dirty_time,
 		   !list_empty(&bdi->bdi_list), bdi->wb.state);
+#ifdef CONFIG_BLK_DIRTY_LAT
+	seq_printf(m,
+		   "DirtyLatStep:       %10u\n"
+		   "DirtyLatRead:       %10llu us\n"
+		   "DirtyLatWrite:      %10llu us\n"
+		   "DirtyLatThrottled:  %10lu\n"
+		   "DirtyLatRelaxed:    %10lu\n",
+		   bdi_dirty_lat_step(bdi),
+		   div_u64(READ_ONCE(bdi->dirty_lat_read_nsec), 1000),
+		   div_u64(READ_ONCE(bdi->dirty_lat_write_nsec), 1000),
+		   READ_ONCE(bdi->dirty_lat_throttled),
+		   READ_ONCE(bdi->dirty_lat_relaxed));
+#endif
 #undef K
 
 	return 0;
@@ -39,6 +39,7 @@
 #include <linux/rmap.h>
 #include <linux/delayacct.h>
 #include <linux/psi.h>
+#include <linux/workqueue.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -2711,6 +2712,64 @@ int filemap_fault(struct vm_fault *vmf)
 }
 EXPORT_SYMBOL(filemap_fault);
 
+struct mmap_async_ra {
+	struct work_struct work;
+	struct file *file;
+	pgoff_t index;
+	unsigned long req_size;
+};
+
+static void mmap_async_ra_work(struct work_struct *work)
+{
+	struct mmap_async_ra *ra = container_of(work, struct mmap_async_ra,
+						work);
+	struct file *file = ra->file;
+	struct address_space *mapping = file->f_mapping;
+	struct page *page;
+
+	page = find_get_page(mapping, ra->index);
+	if (page) {
+		page_cache_async_readahead(mapping, &file->f_ra, file, page,
+					   ra->index, ra->req_size);
+		put_page(page);
+	}
+	fput(file);
+	kfree(ra);
+}
+
+/*
+ * Fault-around found a readahead marker.  We are under the page table
+ * lock and can't issue I/O here, so kick the async readahead off to a
+ * worker, sized by how many pages fault-around has mapped so far.
+ */
+static bool filemap_map_async_readahead(struct vm_fault *vmf,
+					struct page *page,
+					unsigned long req_size)
+{
+	struct file *file = vmf->vma->vm_file;
+	struct mmap_async_ra *ra;
+
+	if (vmf->vma->vm_flags & VM_RAND_READ || !file->f_ra.ra_pages)
+		return false;
+	if (PageWriteback(page))
+		return false;
+
+	ra = kmalloc(sizeof(*ra), GFP_ATOMIC | __GFP_NOWARN);
+	if (!ra)
+		return false;
+	if (!TestClearPageReadahead(page)) {
+		kfree(ra);
+		return true;
+	}
+
+	INIT_WORK(&ra->work, mmap_async_ra_work);
+	ra->file = get_file(file);
+	ra->index = page->index;
+	ra->req_size = min_t(unsigned long, req_size, file->f_ra.ra_pages);
+	queue_work(system_unbound_wq, &ra->work);
+	return true;
+}
+
 void filemap_map_pages(struct vm_fault *vmf,
 		pgoff_t start_pgoff, pgoff_t end_pgoff)
 {
@@ -2755,9 +2814,11 @@ void filemap_map_pages(struct vm_fault *vmf,
 			goto repeat;
 		}
 
-		if (!PageUptodate(page) ||
-				PageReadahead(page) ||
-				PageHWPoison(page))
+		if (!PageUptodate(page) || PageHWPoison(page))
+			goto skip;
+		if (PageReadahead(page) &&
+		    !filemap_map_async_readahead(vmf, page,
+						 iter.index - start_pgoff + 1))
 			goto skip;
 		if (!trylock_page(page))
 			goto skip;
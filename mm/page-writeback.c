@@ -786,6 +786,9 @@ static unsigned long __wb_calc_thresh(struct dirty_throttle_control *dtc)
 	if (wb_thresh > (thresh * wb_max_ratio) / 100)
 		wb_thresh = thresh * wb_max_ratio / 100;
 
+	/* shrink it while reads on the device miss their latency target */
+	wb_thresh >>= bdi_dirty_lat_step(dtc->wb->bdi);
+
 	return wb_thresh;
 }
 
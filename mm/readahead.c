@@ -22,6 +22,9 @@
 
 #include "internal.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -376,8 +379,124 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Is @offset where a sequential stream with this window is expected next?
+ */
+static inline bool ra_window_expects(pgoff_t start, unsigned int size,
+				     unsigned int async_size, pgoff_t offset)
+{
+	return offset == start + size - async_size || offset == start + size;
+}
+
+/*
+ * A new window is about to replace the current one: keep the current one
+ * around as the newest saved stream, in case the access that starts the
+ * new window is just interleaved with it.  The oldest saved stream is
+ * dropped; its async part was read ahead and never asked for.
+ */
+static void ra_save_stream(struct file_ra_state *ra)
+{
+	struct file_ra_stream *oldest = &ra->streams[RA_STREAMS - 2];
+
+	if (!ra->size)
+		return;
+	/* a run of random misses keeps offering the same window */
+	if (ra->streams[0].start == ra->start &&
+	    ra->streams[0].size == ra->size)
+		return;
+
+	if (oldest->size)
+		ra->waste += oldest->async_size;
+
+	memmove(&ra->streams[1], &ra->streams[0],
+		sizeof(ra->streams) - sizeof(ra->streams[0]));
+	ra->streams[0].start = ra->start;
+	ra->streams[0].size = ra->size;
+	ra->streams[0].async_size = ra->async_size;
+}
+
+/*
+ * If @offset continues one of the saved streams, make it the current
+ * window, saving the current one in its place.
+ */
+static bool ra_switch_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream *s;
+	struct file_ra_stream cur = {
+		.start = ra->start,
+		.size = ra->size,
+		.async_size = ra->async_size,
+	};
+
+	for (s = ra->streams; s < ra->streams + RA_STREAMS - 1; s++) {
+		if (!s->size ||
+		    !ra_window_expects(s->start, s->size, s->async_size, offset))
+			continue;
+
+		ra->start = s->start;
+		ra->size = s->size;
+		ra->async_size = s->async_size;
+		*s = cur;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Random misses at a constant distance from each other: read ahead the
+ * next strides, more of them the longer the pattern has held.  Returns
+ * false if there is no pattern (yet); otherwise the number of pages
+ * submitted is stored in @nr_pages.
+ */
+static bool ra_strided_readahead(struct address_space *mapping,
+				 struct file_ra_state *ra,
+				 struct file *filp, pgoff_t offset,
+				 unsigned long req_size,
+				 unsigned long max_pages,
+				 unsigned long *nr_pages)
+{
+	long delta = offset - ra->last_miss;
+	unsigned int i, strides;
+
+	ra->last_miss = offset;
+
+	if (delta != ra->stride || abs(delta) <= req_size ||
+	    abs(delta) > max_pages * 64) {
+		ra->stride = delta;
+		ra->stride_count = 0;
+		return false;
+	}
+
+	if (++ra->stride_count < 2)
+		return false;
+	ra->hits++;
+
+	*nr_pages = 0;
+	strides = min_t(unsigned long, ra->stride_count,
+			max(max_pages / req_size, 1UL));
+	for (i = 0; i < strides; i++) {
+		pgoff_t index = offset + i * delta;
+
+		if (delta < 0 && index > offset)
+			break;
+		*nr_pages += __do_page_cache_readahead(mapping, filp, index,
+						       req_size, 0);
+		/* the next miss is expected one stride after the last read */
+		ra->last_miss = index;
+	}
+
+	return true;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
+ *
+ * On top of the current window, the windows of a few interleaved
+ * sequential streams are remembered, so that e.g. several threads reading
+ * different parts of a file through one fd don't keep restarting each
+ * other's readahead; and random misses at a constant distance are
+ * recognized as a strided pattern.
  */
 static unsigned long
 ondemand_readahead(struct address_space *mapping,
@@ -388,7 +507,9 @@ ondemand_readahead(struct address_space *mapping,
 	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
 	unsigned long max_pages = ra->ra_pages;
 	unsigned long add_pages;
+	unsigned long nr_pages;
 	pgoff_t prev_offset;
+	int pattern;
 
 	/*
 	 * If the request exceeds the readahead window, allow the read to
@@ -400,15 +521,24 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * start of file
 	 */
-	if (!offset)
+	if (!offset) {
+		pattern = RA_PATTERN_INITIAL;
 		goto initial_readahead;
+	}
 
 	/*
 	 * It's the expected callback offset, assume sequential access.
-	 * Ramp up sizes, and push forward the readahead window.
+	 * Ramp up sizes, and push forward the readahead window.  The
+	 * offset may also continue an interleaved stream's saved window.
 	 */
-	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
+	if (ra_window_expects(ra->start, ra->size, ra->async_size, offset))
+		pattern = RA_PATTERN_SEQUENTIAL;
+	else if (ra_switch_stream(ra, offset))
+		pattern = RA_PATTERN_STREAM;
+	else
+		pattern = -1;
+	if (pattern >= 0) {
+		ra->hits++;
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max_pages);
 		ra->async_size = ra->size;
@@ -431,6 +561,9 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max_pages)
 			return 0;
 
+		ra->hits++;
+		ra_save_stream(ra);
+		pattern = RA_PATTERN_MARKER;
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -442,6 +575,7 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * oversize read
 	 */
+	pattern = RA_PATTERN_INITIAL;
 	if (req_size > max_pages)
 		goto initial_readahead;
 
@@ -458,16 +592,33 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max_pages))
+	ra_save_stream(ra);
+	if (try_context_readahead(mapping, ra, offset, req_size, max_pages)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
+
+	/*
+	 * Misses at a constant distance: read the next strides too.
+	 */
+	if (ra_strided_readahead(mapping, ra, filp, offset, req_size,
+				 max_pages, &nr_pages)) {
+		trace_ondemand_readahead(mapping, ra, offset, req_size,
+					 RA_PATTERN_STRIDE, nr_pages);
+		return nr_pages;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	nr_pages = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	trace_ondemand_readahead(mapping, ra, offset, req_size,
+				 RA_PATTERN_RANDOM, nr_pages);
+	return nr_pages;
 
 initial_readahead:
+	ra_save_stream(ra);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max_pages);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -490,7 +641,10 @@ ondemand_readahead(struct address_space *mapping,
 		}
 	}
 
-	return ra_submit(ra, mapping, filp);
+	nr_pages = ra_submit(ra, mapping, filp);
+	trace_ondemand_readahead(mapping, ra, offset, req_size, pattern,
+				 nr_pages);
+	return nr_pages;
 }
 
 /**
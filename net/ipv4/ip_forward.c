@@ -72,6 +72,8 @@ static int ip_forward_finish(struct net *net, struct sock *sk, struct sk_buff *s
 	if (unlikely(opt->optlen))
 		ip_forward_options(skb);
 
+	/* The receive timestamp must not be taken as a departure time */
+	skb->tstamp = 0;
 	return dst_output(net, sk, skb);
 }
 
@@ -932,22 +932,27 @@ enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
 	return HRTIMER_NORESTART;
 }
 
-static void tcp_internal_pacing(struct sock *sk, const struct sk_buff *skb)
+/* Advance the earliest departure time of the next data packet by the
+ * serialization time of the one just sent at sk_pacing_rate. If we were
+ * late sending this one (credit), give back up to half of its budget so
+ * that scheduling jitter does not lower the effective rate.
+ */
+static void tcp_update_wstamp(struct sock *sk, unsigned int len,
+			      u64 prior_wstamp)
 {
-	u64 len_ns;
-	u32 rate;
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 rate = sk->sk_pacing_rate;
+	u64 len_ns, credit;
 
-	if (!tcp_needs_internal_pacing(sk))
-		return;
-	rate = sk->sk_pacing_rate;
-	if (!rate || rate == ~0U)
+	/* Original sch_fq does not pace first 10 MSS */
+	if (!rate || rate == ~0U || tp->data_segs_out < 10)
 		return;
 
-	len_ns = (u64)skb->len * NSEC_PER_SEC;
+	len_ns = (u64)len * NSEC_PER_SEC;
 	do_div(len_ns, rate);
-	hrtimer_start(&tcp_sk(sk)->pacing_timer,
-		      ktime_add_ns(ktime_get(), len_ns),
-		      HRTIMER_MODE_ABS_PINNED);
+	credit = tp->tcp_wstamp_ns - prior_wstamp;
+	len_ns -= min_t(u64, len_ns / 2, credit);
+	tp->tcp_wstamp_ns += len_ns;
 }
 
 /* This routine actually transmits TCP packets queued in by
@@ -973,10 +978,15 @@ static int __tcp_transmit_skb(struct sock *sk, struct sk_buff *skb,
 	struct sk_buff *oskb = NULL;
 	struct tcp_md5sig_key *md5;
 	struct tcphdr *th;
+	unsigned int len;
+	u64 prior_wstamp;
+	bool paced;
 	int err;
 
 	BUG_ON(!skb || !tcp_skb_pcount(skb));
 	tp = tcp_sk(sk);
+	prior_wstamp = tp->tcp_wstamp_ns;
+	tp->tcp_wstamp_ns = max(tp->tcp_wstamp_ns, tp->tcp_clock_cache);
 
 	if (clone_it) {
 		TCP_SKB_CB(skb)->tx.in_flight = TCP_SKB_CB(skb)->end_seq
@@ -1080,7 +1090,6 @@ static int __tcp_transmit_skb(struct sock *sk, struct sk_buff *skb,
 	if (skb->len != tcp_header_size) {
 		tcp_event_data_sent(tp, sk);
 		tp->data_segs_out += tcp_skb_pcount(skb);
-		tcp_internal_pacing(sk, skb);
 	}
 
 	if (after(tcb->end_seq, tp->snd_nxt) || tcb->seq == tcb->end_seq)
@@ -1092,8 +1101,13 @@ static int __tcp_transmit_skb(struct sock *sk, struct sk_buff *skb,
 	skb_shinfo(skb)->gso_segs = tcp_skb_pcount(skb);
 	skb_shinfo(skb)->gso_size = tcp_skb_mss(skb);
 
-	/* Our usage of tstamp should remain private */
-	skb->tstamp = 0;
+	/* Our usage of tstamp should remain private. Paced data packets
+	 * carry their earliest departure time instead, for sch_fq.
+	 */
+	paced = skb->len != tcp_header_size &&
+		sk->sk_pacing_status != SK_PACING_NONE;
+	skb->tstamp = paced ? tp->tcp_wstamp_ns : 0;
+	len = skb->len;
 
 	/* Cleanup our debris for IP stacks */
 	memset(skb->cb, 0, max(sizeof(struct inet_skb_parm),
@@ -1105,6 +1119,8 @@ static int __tcp_transmit_skb(struct sock *sk, struct sk_buff *skb,
 		tcp_enter_cwr(sk);
 		err = net_xmit_eval(err);
 	}
+	if (!err && paced)
+		tcp_update_wstamp(sk, len, prior_wstamp);
 	if (!err && oskb) {
 		oskb->skb_mstamp = tp->tcp_mstamp;
 		tcp_rate_skb_sent(sk, oskb);
@@ -2172,10 +2188,25 @@ static int tcp_mtu_probe(struct sock *sk)
 	return -1;
 }
 
-static bool tcp_pacing_check(const struct sock *sk)
+/* With internal pacing, hold the next data packet until its departure
+ * time. A single absolute timer is armed for it, instead of one per
+ * packet sent.
+ */
+static bool tcp_pacing_check(struct sock *sk)
 {
-	return tcp_needs_internal_pacing(sk) &&
-	       hrtimer_active(&tcp_sk(sk)->pacing_timer);
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!tcp_needs_internal_pacing(sk))
+		return false;
+
+	if (tp->tcp_wstamp_ns <= tp->tcp_clock_cache)
+		return false;
+
+	if (!hrtimer_is_queued(&tp->pacing_timer))
+		hrtimer_start(&tp->pacing_timer,
+			      ns_to_ktime(tp->tcp_wstamp_ns),
+			      HRTIMER_MODE_ABS_PINNED);
+	return true;
 }
 
 /* TCP Small Queues :
@@ -65,8 +65,6 @@ static int ingress_init(struct Qdisc *sch, struct nlattr *opt)
 	if (err)
 		return err;
 
-	sch->flags |= TCQ_F_CPUSTATS;
-
 	return 0;
 }
 
@@ -109,6 +107,7 @@ static struct Qdisc_ops ingress_qdisc_ops __read_mostly = {
 	.init		=	ingress_init,
 	.destroy	=	ingress_destroy,
 	.dump		=	ingress_dump,
+	.static_flags	=	TCQ_F_CPUSTATS,
 	.owner		=	THIS_MODULE,
 };
 
@@ -165,8 +164,6 @@ static int clsact_init(struct Qdisc *sch, struct nlattr *opt)
 	if (err)
 		return err;
 
-	sch->flags |= TCQ_F_CPUSTATS;
-
 	return 0;
 }
 
@@ -197,6 +194,7 @@ static struct Qdisc_ops clsact_qdisc_ops __read_mostly = {
 	.init		=	clsact_init,
 	.destroy	=	clsact_destroy,
 	.dump		=	ingress_dump,
+	.static_flags	=	TCQ_F_CPUSTATS,
 	.owner		=	THIS_MODULE,
 };
 
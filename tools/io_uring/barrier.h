@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef LIBURING_BARRIER_H
+#define LIBURING_BARRIER_H
+
+/*
+ * The ring head/tail updates pair with smp_store_release() and
+ * smp_load_acquire() on the kernel side.
+ */
+#define read_barrier()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define write_barrier()		__atomic_thread_fence(__ATOMIC_RELEASE)
+
+#define load_acquire(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#endif
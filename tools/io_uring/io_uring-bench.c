@@ -0,0 +1,657 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Simple benchmark program that uses the various features of io_uring
+ * to provide fast random access to a device/file. It has various
+ * options that are control how we use io_uring, see the OPTIONS section
+ * below. This uses the raw io_uring interface.
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "syscall.h"
+#include "barrier.h"
+
+struct io_sq_ring {
+	unsigned *head;
+	unsigned *tail;
+	unsigned *ring_mask;
+	unsigned *ring_entries;
+	unsigned *dropped;
+	unsigned *array;
+};
+
+struct io_cq_ring {
+	unsigned *head;
+	unsigned *tail;
+	unsigned *ring_mask;
+	unsigned *ring_entries;
+	unsigned *overflow;
+	struct io_uring_cqe *cqes;
+};
+
+#define MAX_FDS		16
+#define MAX_DEPTH	4096
+
+struct file {
+	unsigned long max_blocks;
+	unsigned pending_ios;
+	int real_fd;
+	int fixed_fd;
+};
+
+struct submitter {
+	pthread_t thread;
+	int ring_fd;
+	struct io_sq_ring sq_ring;
+	struct io_uring_sqe *sqes;
+	struct iovec iovecs[MAX_DEPTH];
+	struct io_cq_ring cq_ring;
+	int inflight;
+	unsigned long reaps;
+	unsigned long done;
+	unsigned long calls;
+	unsigned long errors;
+	volatile int finish;
+
+	unsigned long long lat_sum;	/* nsec */
+	unsigned long long lat_nr;
+	struct timespec *issue_ts;
+
+	/* sqe/buffer slots not currently owned by an inflight io */
+	unsigned free_idx[MAX_DEPTH];
+	unsigned nr_free;
+
+	struct file files[MAX_FDS];
+	unsigned nr_files;
+	unsigned cur_file;
+};
+
+static struct submitter submitters[1];
+static volatile int finish;
+
+/*
+ * OPTIONS: Set these via the command line
+ */
+static int depth = 128;			/* -d: io queue depth */
+static int batch_submit = 32;		/* -s: ios submitted per call */
+static int batch_complete = 32;		/* -c: ios reaped per call */
+static int bs = 4096;			/* -b: block size */
+static int fixedbufs = 1;		/* -B: use fixed user buffers */
+static int register_files = 1;		/* -F: use fixed files */
+static int buffered;			/* -O0: use buffered IO, not O_DIRECT */
+static int do_write;			/* -w: random writes instead of reads */
+static int runtime;			/* -t: stop after this many seconds */
+
+static int io_uring_register_buffers(struct submitter *s)
+{
+	return io_uring_register(s->ring_fd, IORING_REGISTER_BUFFERS,
+					s->iovecs, depth);
+}
+
+static int io_uring_register_files(struct submitter *s)
+{
+	int fds[MAX_FDS];
+	unsigned i;
+
+	for (i = 0; i < s->nr_files; i++) {
+		fds[i] = s->files[i].real_fd;
+		s->files[i].fixed_fd = i;
+	}
+
+	return io_uring_register(s->ring_fd, IORING_REGISTER_FILES, fds,
+					s->nr_files);
+}
+
+static unsigned long long ts_nsec(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static struct file *get_next_file(struct submitter *s)
+{
+	struct file *f;
+
+	if (s->nr_files == 1)
+		return &s->files[0];
+
+	f = &s->files[s->cur_file];
+	if (++s->cur_file == s->nr_files)
+		s->cur_file = 0;
+	return f;
+}
+
+static void init_io(struct submitter *s, unsigned index)
+{
+	struct io_uring_sqe *sqe = &s->sqes[index];
+	unsigned long offset;
+	struct file *f;
+	long r;
+
+	f = get_next_file(s);
+	f->pending_ios++;
+
+	r = lrand48();
+	offset = (r % (f->max_blocks - 1)) * bs;
+
+	if (register_files) {
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->fd = f->fixed_fd;
+	} else {
+		sqe->flags = 0;
+		sqe->fd = f->real_fd;
+	}
+	if (fixedbufs) {
+		sqe->opcode = do_write ? IORING_OP_WRITE_FIXED :
+					 IORING_OP_READ_FIXED;
+		sqe->addr = (unsigned long) s->iovecs[index].iov_base;
+		sqe->len = bs;
+		sqe->buf_index = index;
+	} else {
+		sqe->opcode = do_write ? IORING_OP_WRITEV : IORING_OP_READV;
+		sqe->addr = (unsigned long) &s->iovecs[index];
+		sqe->len = 1;
+		sqe->buf_index = 0;
+	}
+	sqe->ioprio = 0;
+	sqe->off = offset;
+	sqe->rw_flags = 0;
+	sqe->user_data = ((unsigned long) (f - s->files) << 32) | index;
+	clock_gettime(CLOCK_MONOTONIC, &s->issue_ts[index]);
+}
+
+static int prep_more_ios(struct submitter *s, int max_ios)
+{
+	struct io_sq_ring *ring = &s->sq_ring;
+	unsigned index, tail;
+	int prepped = 0;
+
+	tail = *ring->tail;
+	while (prepped < max_ios && s->nr_free) {
+		if (tail - load_acquire(ring->head) == *ring->ring_entries)
+			break;
+
+		/*
+		 * Completions come back out of order, so the sqe and buffer
+		 * are picked from the free slots rather than the ring index.
+		 */
+		index = s->free_idx[--s->nr_free];
+		init_io(s, index);
+		ring->array[tail & *ring->ring_mask] = index;
+		prepped++;
+		tail++;
+	}
+
+	if (*ring->tail != tail)
+		store_release(ring->tail, tail);
+	return prepped;
+}
+
+static int get_file_size(struct file *f)
+{
+	struct stat st;
+
+	if (fstat(f->real_fd, &st) < 0)
+		return -1;
+	if (S_ISBLK(st.st_mode)) {
+		unsigned long long bytes;
+
+		if (ioctl(f->real_fd, BLKGETSIZE64, &bytes) != 0)
+			return -1;
+
+		f->max_blocks = bytes / bs;
+		return 0;
+	} else if (S_ISREG(st.st_mode)) {
+		f->max_blocks = st.st_size / bs;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int reap_events(struct submitter *s)
+{
+	struct io_cq_ring *ring = &s->cq_ring;
+	struct io_uring_cqe *cqe;
+	struct timespec now;
+	unsigned head, reaped = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	head = *ring->head;
+	do {
+		unsigned index;
+		struct file *f;
+
+		if (head == load_acquire(ring->tail))
+			break;
+		cqe = &ring->cqes[head & *ring->ring_mask];
+		f = &s->files[cqe->user_data >> 32];
+		index = cqe->user_data & 0xffffffff;
+		f->pending_ios--;
+		if (cqe->res != bs) {
+			if (cqe->res < 0)
+				fprintf(stderr, "io: %s\n", strerror(-cqe->res));
+			else
+				fprintf(stderr, "io: short %d/%d\n", cqe->res, bs);
+			s->errors++;
+		}
+		s->lat_sum += ts_nsec(&now) - ts_nsec(&s->issue_ts[index]);
+		s->lat_nr++;
+		s->free_idx[s->nr_free++] = index;
+		reaped++;
+		head++;
+	} while (1);
+
+	s->inflight -= reaped;
+	store_release(ring->head, head);
+	return reaped;
+}
+
+static void *submitter_fn(void *data)
+{
+	struct submitter *s = data;
+	int ret, prepped;
+
+	printf("submitter=%d\n", (int) syscall(SYS_gettid));
+
+	srand48(time(NULL));
+
+	prepped = 0;
+	do {
+		int to_wait, to_submit, this_reap, to_prep;
+
+		if (!prepped && s->inflight < depth) {
+			to_prep = depth - s->inflight;
+			if (to_prep > batch_submit)
+				to_prep = batch_submit;
+			prepped = prep_more_ios(s, to_prep);
+		}
+		s->inflight += prepped;
+submit_more:
+		to_submit = prepped;
+submit:
+		if (to_submit && (s->inflight + to_submit <= depth))
+			to_wait = 0;
+		else
+			to_wait = batch_complete < s->inflight ?
+					batch_complete : s->inflight;
+
+		s->calls++;
+		ret = io_uring_enter(s->ring_fd, to_submit, to_wait,
+					IORING_ENTER_GETEVENTS, NULL);
+
+		/*
+		 * For non SQ thread, we actually have to reap events, as
+		 * the application must reap them itself.
+		 */
+		this_reap = 0;
+		do {
+			int r;
+
+			r = reap_events(s);
+			if (r == -1) {
+				s->finish = 1;
+				break;
+			} else if (r > 0)
+				this_reap += r;
+		} while (this_reap < to_wait);
+		s->reaps += this_reap;
+
+		if (ret >= 0) {
+			if (!ret) {
+				to_submit = 0;
+				if (s->inflight)
+					goto submit;
+				continue;
+			} else if (ret < to_submit) {
+				int diff = to_submit - ret;
+
+				s->done += ret;
+				prepped -= diff;
+				goto submit_more;
+			}
+			s->done += ret;
+			prepped = 0;
+			continue;
+		} else if (ret < 0) {
+			if (errno == EAGAIN) {
+				if (s->finish)
+					break;
+				if (this_reap)
+					goto submit;
+				to_submit = 0;
+				goto submit;
+			}
+			printf("io_submit: %s\n", strerror(errno));
+			break;
+		}
+	} while (!s->finish);
+
+	finish = 1;
+	return NULL;
+}
+
+static void sig_int(int sig)
+{
+	printf("Exiting on signal %d\n", sig);
+	submitters[0].finish = 1;
+	finish = 1;
+}
+
+static void arm_sig_int(void)
+{
+	struct sigaction act;
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = sig_int;
+	act.sa_flags = SA_RESTART;
+	sigaction(SIGINT, &act, NULL);
+}
+
+static int setup_ring(struct submitter *s)
+{
+	struct io_sq_ring *sring = &s->sq_ring;
+	struct io_cq_ring *cring = &s->cq_ring;
+	struct io_uring_params p;
+	int ret, fd;
+	void *ptr;
+
+	memset(&p, 0, sizeof(p));
+
+	fd = io_uring_setup(depth, &p);
+	if (fd < 0) {
+		perror("io_uring_setup");
+		return 1;
+	}
+
+	s->ring_fd = fd;
+
+	if (fixedbufs) {
+		ret = io_uring_register_buffers(s);
+		if (ret < 0) {
+			perror("io_uring_register_buffers");
+			return 1;
+		}
+	}
+
+	if (register_files) {
+		ret = io_uring_register_files(s);
+		if (ret < 0) {
+			perror("io_uring_register_files");
+			return 1;
+		}
+	}
+
+	ptr = mmap(0, p.sq_off.array + p.sq_entries * sizeof(__u32),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+			IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED) {
+		perror("mmap sq ring");
+		return 1;
+	}
+	printf("sq_ring ptr = 0x%p\n", ptr);
+	sring->head = ptr + p.sq_off.head;
+	sring->tail = ptr + p.sq_off.tail;
+	sring->ring_mask = ptr + p.sq_off.ring_mask;
+	sring->ring_entries = ptr + p.sq_off.ring_entries;
+	sring->dropped = ptr + p.sq_off.dropped;
+	sring->array = ptr + p.sq_off.array;
+
+	s->sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			fd, IORING_OFF_SQES);
+	if (s->sqes == MAP_FAILED) {
+		perror("mmap sqes");
+		return 1;
+	}
+	printf("sqes ptr    = 0x%p\n", s->sqes);
+
+	ptr = mmap(0, p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+			IORING_OFF_CQ_RING);
+	if (ptr == MAP_FAILED) {
+		perror("mmap cq ring");
+		return 1;
+	}
+	printf("cq_ring ptr = 0x%p\n", ptr);
+	cring->head = ptr + p.cq_off.head;
+	cring->tail = ptr + p.cq_off.tail;
+	cring->ring_mask = ptr + p.cq_off.ring_mask;
+	cring->ring_entries = ptr + p.cq_off.ring_entries;
+	cring->overflow = ptr + p.cq_off.overflow;
+	cring->cqes = ptr + p.cq_off.cqes;
+	return 0;
+}
+
+static void file_depths(char *buf)
+{
+	struct submitter *s = &submitters[0];
+	unsigned i;
+	char *p;
+
+	buf[0] = '\0';
+	p = buf;
+	for (i = 0; i < s->nr_files; i++) {
+		struct file *f = &s->files[i];
+
+		if (i + 1 == s->nr_files)
+			p += sprintf(p, "%d", f->pending_ios);
+		else
+			p += sprintf(p, "%d, ", f->pending_ios);
+	}
+}
+
+static void usage(char *argv)
+{
+	printf("%s [options] -- [filenames]\n"
+		" -d <int>  : IO Depth, default %d\n"
+		" -s <int>  : Batch submit, default %d\n"
+		" -c <int>  : Batch complete, default %d\n"
+		" -b <int>  : Block size, default %d\n"
+		" -B <bool> : Fixed buffers, default %d\n"
+		" -F <bool> : Register files, default %d\n"
+		" -O <bool> : Use O_DIRECT, default %d\n"
+		" -w <bool> : Random writes instead of reads, default %d\n"
+		" -t <int>  : Runtime in seconds, 0 = until interrupted\n",
+		argv, depth, batch_submit, batch_complete, bs, fixedbufs,
+		register_files, !buffered, do_write);
+	exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct submitter *s = &submitters[0];
+	unsigned long done, calls, reap, errors;
+	unsigned long long lat_sum, lat_nr;
+	int err, i, flags, fd, opt, elapsed = 0;
+	char *fdepths;
+	void *ret;
+
+	while ((opt = getopt(argc, argv, "d:s:c:b:B:F:O:w:t:h?")) != -1) {
+		switch (opt) {
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 's':
+			batch_submit = atoi(optarg);
+			break;
+		case 'c':
+			batch_complete = atoi(optarg);
+			break;
+		case 'b':
+			bs = atoi(optarg);
+			break;
+		case 'B':
+			fixedbufs = !!atoi(optarg);
+			break;
+		case 'F':
+			register_files = !!atoi(optarg);
+			break;
+		case 'O':
+			buffered = !atoi(optarg);
+			break;
+		case 'w':
+			do_write = !!atoi(optarg);
+			break;
+		case 't':
+			runtime = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(argv[0]);
+			return 0;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (depth < 1 || depth > MAX_DEPTH || bs < 512 ||
+	    batch_submit < 1 || batch_complete < 1) {
+		printf("invalid depth, block size or batch setting\n");
+		return 1;
+	}
+	if (batch_submit > depth)
+		batch_submit = depth;
+	if (batch_complete > depth)
+		batch_complete = depth;
+
+	flags = do_write ? O_WRONLY : O_RDONLY;
+	if (!buffered)
+		flags |= O_DIRECT;
+
+	for (i = optind; i < argc; i++) {
+		struct file *f;
+
+		if (s->nr_files == MAX_FDS) {
+			printf("Max number of files (%d) reached\n", MAX_FDS);
+			break;
+		}
+		fd = open(argv[i], flags);
+		if (fd < 0) {
+			perror("open");
+			return 1;
+		}
+
+		f = &s->files[s->nr_files];
+		f->real_fd = fd;
+		if (get_file_size(f) || f->max_blocks < 2) {
+			printf("failed getting size of device/file %s\n",
+				argv[i]);
+			return 1;
+		}
+		f->max_blocks--;
+
+		printf("Added file %s\n", argv[i]);
+		s->nr_files++;
+	}
+
+	if (fixedbufs) {
+		struct rlimit rlim;
+
+		rlim.rlim_cur = RLIM_INFINITY;
+		rlim.rlim_max = RLIM_INFINITY;
+		if (setrlimit(RLIMIT_MEMLOCK, &rlim) < 0)
+			perror("setrlimit");
+	}
+
+	arm_sig_int();
+
+	s->issue_ts = calloc(depth, sizeof(*s->issue_ts));
+	if (!s->issue_ts)
+		return 1;
+	for (i = 0; i < depth; i++) {
+		void *buf;
+
+		if (posix_memalign(&buf, bs, bs)) {
+			printf("failed alloc\n");
+			return 1;
+		}
+		memset(buf, 0xa5, bs);
+		s->iovecs[i].iov_base = buf;
+		s->iovecs[i].iov_len = bs;
+		s->free_idx[s->nr_free++] = i;
+	}
+
+	err = setup_ring(s);
+	if (err) {
+		printf("ring setup failed: %s, %d\n", strerror(errno), err);
+		return 1;
+	}
+	printf("%s %s, QD=%d, sq_ring=%d, cq_ring=%d, bs=%d\n",
+		buffered ? "buffered" : "O_DIRECT",
+		do_write ? "randwrite" : "randread", depth,
+		*s->sq_ring.ring_entries, *s->cq_ring.ring_entries, bs);
+	printf("fixedbufs=%d, register_files=%d\n", fixedbufs,
+		register_files);
+
+	pthread_create(&s->thread, NULL, submitter_fn, s);
+
+	fdepths = malloc(8 * s->nr_files);
+	reap = calls = done = errors = 0;
+	lat_sum = lat_nr = 0;
+	do {
+		unsigned long this_done = 0;
+		unsigned long this_reap = 0;
+		unsigned long this_call = 0;
+		unsigned long long this_lat = 0, this_lat_nr = 0;
+		unsigned long rpc = 0, ipc = 0;
+
+		sleep(1);
+		this_done += s->done;
+		this_call += s->calls;
+		this_reap += s->reaps;
+		this_lat += s->lat_sum;
+		this_lat_nr += s->lat_nr;
+		if (this_call - calls) {
+			rpc = (this_done - done) / (this_call - calls);
+			ipc = (this_reap - reap) / (this_call - calls);
+		} else
+			rpc = ipc = -1;
+		file_depths(fdepths);
+		printf("IOPS=%lu, BW=%luMiB/s, lat=%lluusec, IOS/call=%ld/%ld, inflight=%u (%s)\n",
+				this_done - done,
+				((this_done - done) * bs) >> 20,
+				this_lat_nr - lat_nr ?
+				(this_lat - lat_sum) / (this_lat_nr - lat_nr) / 1000 : 0,
+				rpc, ipc, s->inflight, fdepths);
+		done = this_done;
+		calls = this_call;
+		reap = this_reap;
+		lat_sum = this_lat;
+		lat_nr = this_lat_nr;
+		if (runtime && ++elapsed >= runtime) {
+			s->finish = 1;
+			finish = 1;
+		}
+	} while (!finish);
+
+	pthread_join(s->thread, &ret);
+	close(s->ring_fd);
+	errors = s->errors;
+	if (errors)
+		printf("%lu IO errors\n", errors);
+	free(fdepths);
+	return errors ? 1 : 0;
+}
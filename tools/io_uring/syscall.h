@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef IO_URING_SYSCALL_H
+#define IO_URING_SYSCALL_H
+
+#include <signal.h>
+#include <linux/io_uring.h>
+
+extern int io_uring_setup(unsigned int entries, struct io_uring_params *p);
+extern int io_uring_enter(int fd, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags,
+			  sigset_t *sig);
+extern int io_uring_register(int fd, unsigned int opcode, void *arg,
+			     unsigned int nr_args);
+
+#endif